@@ -0,0 +1,365 @@
+#ifndef FACTORIZE_CARTESIAN_LEVELS_HPP
+#define FACTORIZE_CARTESIAN_LEVELS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "sanisizer/sanisizer.hpp"
+#include "subpar/subpar.hpp"
+
+#include "utils.hpp"
+
+/**
+ * @file CartesianLevels.hpp
+ * @brief Lazy description of the levels of a Cartesian product of factors.
+ */
+
+namespace factorize {
+
+/**
+ * @cond
+ */
+namespace internal {
+
+// Unsigned integer type that is used for the arithmetic on the combined codes.
+template<typename Code_>
+using CartesianWord = typename std::conditional<(std::numeric_limits<Code_>::digits <= 32), std::uint32_t, std::uint64_t>::type;
+
+inline std::uint32_t multiply_high(const std::uint32_t a, const std::uint32_t b) {
+    return (static_cast<std::uint64_t>(a) * static_cast<std::uint64_t>(b)) >> 32;
+}
+
+inline std::uint64_t multiply_high(const std::uint64_t a, const std::uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 Wide;
+    return (static_cast<Wide>(a) * static_cast<Wide>(b)) >> 64;
+#else
+    const std::uint64_t mask = 0xFFFFFFFF;
+    const std::uint64_t alo = a & mask, ahi = a >> 32, blo = b & mask, bhi = b >> 32;
+    const std::uint64_t lolo = alo * blo, lohi = alo * bhi, hilo = ahi * blo, hihi = ahi * bhi;
+    const std::uint64_t carry = ((lolo >> 32) + (lohi & mask) + (hilo & mask)) >> 32;
+    return hihi + (lohi >> 32) + (hilo >> 32) + carry;
+#endif
+}
+
+// Division by a runtime constant via multiplication by a precomputed reciprocal and a shift.
+// This uses the round-up method of Granlund and Montgomery (1994), in the same form as the unsigned dividers in libdivide.
+template<typename Word_>
+class FastDivider {
+public:
+    FastDivider() = default;
+
+    FastDivider(const Word_ divisor) {
+        if (divisor == 0) {
+            return;
+        }
+
+        unsigned char floor_log2 = 0;
+        while ((divisor >> floor_log2) > 1) {
+            ++floor_log2;
+        }
+        my_shift = floor_log2;
+
+        const Word_ power = static_cast<Word_>(1) << floor_log2;
+        if (power == divisor) {
+            return; // just a shift, so my_magic = 0.
+        }
+
+        // Long division of (power * 2^W) by the divisor, which only needs to be done once so we don't bother with anything clever.
+        // We know that the quotient fits into a single word as power < divisor.
+        constexpr int nbits = std::numeric_limits<Word_>::digits;
+        Word_ proposed = 0, remainder = power;
+        for (int b = 0; b < nbits; ++b) {
+            const bool carry = (remainder >> (nbits - 1)) != 0;
+            remainder <<= 1;
+            proposed <<= 1;
+            if (carry || remainder >= divisor) {
+                remainder -= divisor;
+                proposed |= 1;
+            }
+        }
+
+        if (divisor - remainder >= power) {
+            // Magic number needs an extra bit, which is handled by the addition in divide().
+            proposed += proposed;
+            const Word_ twice_remainder = remainder + remainder;
+            if (twice_remainder >= divisor || twice_remainder < remainder) {
+                proposed += 1;
+            }
+            my_add = true;
+        }
+        my_magic = proposed + 1;
+    }
+
+private:
+    Word_ my_magic = 0;
+    unsigned char my_shift = 0;
+    bool my_add = false;
+
+public:
+    Word_ divide(const Word_ x) const {
+        if (my_magic == 0) {
+            return x >> my_shift;
+        }
+        const Word_ q = multiply_high(my_magic, x);
+        if (my_add) {
+            return (((x - q) >> 1) + q) >> my_shift;
+        } else {
+            return q >> my_shift;
+        }
+    }
+};
+
+// Fills the levels of each variable for all combinations in [start, start + length).
+// Each variable's levels consist of runs of identical values (of length equal to its stride) that cycle through all of its levels,
+// so we just track our position in the current run and cycle to avoid any division in the inner loop.
+template<typename Code_, typename Level_>
+void fill_cartesian_levels(const std::vector<Code_>& counts, const std::vector<Code_>& strides, const Code_ start, const Code_ length, std::vector<std::vector<Level_> >& output) {
+    const auto nvariables = counts.size();
+    for (I<decltype(nvariables)> f = 0; f < nvariables; ++f) {
+        const Code_ stride = strides[f];
+        const Code_ nlevels = counts[f];
+        Code_ position = start % stride;
+        Code_ level = (start / stride) % nlevels;
+
+        auto oIt = output[f].begin() + start;
+        Code_ remaining = length;
+        while (remaining > 0) {
+            const Code_ run = std::min<Code_>(stride - position, remaining);
+            std::fill_n(oIt, run, static_cast<Level_>(level));
+            oIt += run;
+            remaining -= run;
+            position = 0;
+            ++level;
+            if (level == nlevels) {
+                level = 0;
+            }
+        }
+    }
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Levels of a Cartesian product of factors.
+ *
+ * This describes all combinations of levels from multiple factors, e.g., as computed by `combine_to_factor_unused()`,
+ * without materializing a vector of length equal to the number of combinations for each factor.
+ * Each combination is identified by a code that is computed from the per-factor codes in mixed-radix form, where the first factor is the slowest changing.
+ * The per-factor code for any combination can be computed in constant time from the counts and strides.
+ *
+ * @tparam Code_ Integer type for the combined codes.
+ * This should be large enough to hold the number of combinations.
+ */
+template<typename Code_>
+class CartesianLevels {
+public:
+    /**
+     * Default constructor, equivalent to a product of zero factors.
+     */
+    CartesianLevels() = default;
+
+    /**
+     * @tparam Number_ Integer type for the number of levels in each factor.
+     * @param counts Number of levels for each factor.
+     * An error is raised if the product of these numbers cannot be stored in `Code_`.
+     */
+    template<typename Number_>
+    CartesianLevels(const std::vector<Number_>& counts) {
+        const auto nvariables = counts.size();
+        sanisizer::resize(my_counts, nvariables);
+        sanisizer::resize(my_strides, nvariables);
+        for (auto f = nvariables; f > 0; --f) {
+            my_counts[f - 1] = sanisizer::cast<Code_>(counts[f - 1]);
+            my_strides[f - 1] = my_size;
+            my_size = sanisizer::product<Code_>(my_size, counts[f - 1]);
+        }
+
+        sanisizer::resize(my_count_dividers, nvariables);
+        sanisizer::resize(my_stride_dividers, nvariables);
+        for (I<decltype(nvariables)> f = 0; f < nvariables; ++f) {
+            my_count_dividers[f] = Divider(my_counts[f]);
+            my_stride_dividers[f] = Divider(my_strides[f]);
+        }
+    }
+
+private:
+    std::vector<Code_> my_counts, my_strides;
+    Code_ my_size = 1;
+
+    typedef internal::CartesianWord<Code_> Word;
+    typedef internal::FastDivider<Word> Divider;
+    std::vector<Divider> my_count_dividers, my_stride_dividers;
+
+    Word extract(const std::size_t f, const Word code) const {
+        const Word quotient = my_stride_dividers[f].divide(code);
+        return quotient - my_count_dividers[f].divide(quotient) * static_cast<Word>(my_counts[f]);
+    }
+
+public:
+    /**
+     * @return Number of factors.
+     */
+    std::size_t num_variables() const {
+        return my_counts.size();
+    }
+
+    /**
+     * @return Number of combinations, i.e., the product of the number of levels across all factors.
+     */
+    Code_ size() const {
+        return my_size;
+    }
+
+    /**
+     * @return Number of levels for each factor.
+     */
+    const std::vector<Code_>& counts() const {
+        return my_counts;
+    }
+
+    /**
+     * @return Stride of each factor, i.e., the difference in the combined code when the code of that factor is incremented by 1.
+     */
+    const std::vector<Code_>& strides() const {
+        return my_strides;
+    }
+
+    /**
+     * @param f Index of the factor.
+     * @param code Combined code, less than `size()`.
+     * @return Code of factor `f` in the combination corresponding to `code`.
+     */
+    Code_ level(const std::size_t f, const Code_ code) const {
+        return extract(f, code);
+    }
+
+    /**
+     * Decode combined codes into the codes of a single factor.
+     * Divisions by the strides and counts are replaced with multiplications by precomputed reciprocals.
+     *
+     * @tparam Level_ Integer type for the per-factor codes.
+     * @param f Index of the factor.
+     * @param n Number of observations.
+     * @param[in] codes Pointer to an array of length `n` containing the combined codes.
+     * @param[out] levels Pointer to an array of length `n` in which to store the codes for factor `f`.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Level_>
+    void decode(const std::size_t f, const std::size_t n, const Code_* const codes, Level_* const levels, const int num_threads = 1) const {
+        subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+            for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+                levels[i] = extract(f, codes[i]);
+            }
+        });
+    }
+
+    /**
+     * Decode combined codes into the codes of all factors.
+     * This peels off the code for each factor from the last to the first, so only one division (by a precomputed reciprocal) is required per factor and observation.
+     *
+     * @tparam Level_ Integer type for the per-factor codes.
+     * @param n Number of observations.
+     * @param[in] codes Pointer to an array of length `n` containing the combined codes.
+     * @param[out] levels Vector of length equal to `num_variables()`.
+     * Each entry is a pointer to an array of length `n` in which to store the codes for the corresponding factor.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Level_>
+    void decode(const std::size_t n, const Code_* const codes, const std::vector<Level_*>& levels, const int num_threads = 1) const {
+        decode_tiles(n, codes, num_threads, [&](const std::size_t f, const std::size_t i, const Word level) -> void {
+            levels[f][i] = level;
+        });
+    }
+
+    /**
+     * Decode combined codes into the codes of all factors, stored in an interleaved layout.
+     *
+     * @tparam Level_ Integer type for the per-factor codes.
+     * @param n Number of observations.
+     * @param[in] codes Pointer to an array of length `n` containing the combined codes.
+     * @param[out] levels Pointer to an array of length equal to the product of `n` and `num_variables()`.
+     * On output, the code of factor `f` for observation `i` is stored in `levels[i * num_variables() + f]`.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Level_>
+    void decode_interleaved(const std::size_t n, const Code_* const codes, Level_* const levels, const int num_threads = 1) const {
+        const auto nvariables = my_counts.size();
+        decode_tiles(n, codes, num_threads, [&](const std::size_t f, const std::size_t i, const Word level) -> void {
+            levels[sanisizer::product_unsafe<std::size_t>(i, nvariables) + f] = level;
+        });
+    }
+
+private:
+    template<class Store_>
+    void decode_tiles(const std::size_t n, const Code_* const codes, const int num_threads, Store_ store) const {
+        const auto nvariables = my_counts.size();
+        if (nvariables == 0) {
+            return;
+        }
+
+        subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+            constexpr std::size_t tile_size = 4096;
+            std::vector<Word> remaining(std::min(tile_size, length));
+            for (I<decltype(length)> offset = 0; offset < length; offset += tile_size) {
+                const auto tile_start = start + offset;
+                const auto tile_length = std::min(tile_size, length - offset);
+                std::copy_n(codes + tile_start, tile_length, remaining.data());
+
+                for (auto f = nvariables; f > 1; --f) {
+                    const auto& divider = my_count_dividers[f - 1];
+                    const Word count = my_counts[f - 1];
+                    for (I<decltype(tile_length)> i = 0; i < tile_length; ++i) {
+                        const Word quotient = divider.divide(remaining[i]);
+                        store(f - 1, tile_start + i, remaining[i] - quotient * count);
+                        remaining[i] = quotient;
+                    }
+                }
+
+                // The first factor is the slowest changing, so whatever's left over must be its code.
+                for (I<decltype(tile_length)> i = 0; i < tile_length; ++i) {
+                    store(0, tile_start + i, remaining[i]);
+                }
+            }
+        });
+    }
+
+public:
+    /**
+     * Materialize the levels of all combinations, e.g., to obtain the same output as `combine_to_factor_unused()`.
+     *
+     * @tparam Level_ Type of the levels.
+     * This should be constructible from `Code_`.
+     * @param num_threads Number of threads to use.
+     * @return Vector of length equal to `num_variables()`, where each inner vector has length equal to `size()`.
+     * For each combined code `c`, the code of factor `f` is stored in `output[f][c]`.
+     */
+    template<typename Level_>
+    std::vector<std::vector<Level_> > materialize(const int num_threads = 1) const {
+        const auto nvariables = my_counts.size();
+        auto output = sanisizer::create<std::vector<std::vector<Level_> > >(nvariables);
+        if (nvariables == 0) {
+            return output;
+        }
+
+        sanisizer::cast<I<decltype(output[0].size())> >(my_size); // check that we can actually make the output vectors.
+        for (auto& out : output) {
+            out.resize(my_size);
+        }
+        subpar::parallelize_range(num_threads, my_size, [&](const int, const Code_ start, const Code_ length) -> void {
+            internal::fill_cartesian_levels(my_counts, my_strides, start, length, output);
+        });
+        return output;
+    }
+};
+
+}
+
+#endif
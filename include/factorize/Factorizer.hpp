@@ -0,0 +1,102 @@
+#ifndef FACTORIZE_FACTORIZER_HPP
+#define FACTORIZE_FACTORIZER_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include "utils.hpp"
+#include "FlatHashMap.hpp"
+#include "create_factor.hpp"
+
+/**
+ * @file Factorizer.hpp
+ * @brief Create a factor from a categorical variable in chunks.
+ */
+
+namespace factorize {
+
+/**
+ * @brief Results of `Factorizer::finish()`.
+ *
+ * @tparam Input_ Type of the categorical variable.
+ * @tparam Code_ Integer type for the factor codes.
+ */
+template<typename Input_, typename Code_>
+struct FactorizerResults {
+    /**
+     * Unique and sorted values of the categorical variable, i.e., the factor levels.
+     */
+    std::vector<Input_> levels;
+
+    /**
+     * Vector of length equal to `levels.size()`, mapping each provisional code to its final code.
+     * For a provisional code `p` reported by `Factorizer::add()`, the final code is `remapping[p]` such that `levels[remapping[p]]` is the original value.
+     */
+    std::vector<Code_> remapping;
+};
+
+/**
+ * @brief Create a factor from chunks of a categorical variable.
+ *
+ * This is a streaming version of `create_factor()` for when the categorical variable is not available as a single contiguous array,
+ * e.g., when it is being loaded in chunks from file.
+ * Each chunk is supplied to `add()`, which reports provisional codes for its observations.
+ * Once all chunks are processed, `finish()` returns the sorted levels and the remapping from provisional to final codes.
+ * The caller is then responsible for applying this remapping to the provisional codes of each chunk.
+ *
+ * @tparam Input_ Type of the categorical variable.
+ * Any type may be used here as long as it is hashable, has an equality operator and is sortable.
+ * @tparam Code_ Integer type for the factor codes.
+ */
+template<typename Input_, typename Code_>
+class Factorizer {
+public:
+    /**
+     * @param expected Expected number of unique values.
+     * This is only used to pre-allocate memory and does not need to be exact.
+     */
+    Factorizer(const std::size_t expected = 0) : my_mapping(expected) {}
+
+private:
+    internal::FlatHashMap<Input_, Code_> my_mapping;
+
+public:
+    /**
+     * Add a chunk of observations.
+     *
+     * @param n Number of observations in this chunk.
+     * @param[in] input Pointer to an array of length `n` containing the categorical variable for this chunk.
+     * @param[out] codes Pointer to an array of length `n` in which the provisional codes are to be stored.
+     * Provisional codes are assigned in order of first appearance across all chunks, and are consistent across chunks,
+     * i.e., observations with the same value will always have the same provisional code.
+     */
+    void add(const std::size_t n, const Input_* const input, Code_* const codes) {
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            codes[i] = my_mapping.insert(input[i]).first;
+        }
+    }
+
+    /**
+     * @return Number of unique values observed so far, equal to the largest provisional code plus 1.
+     */
+    std::size_t size() const {
+        return my_mapping.size();
+    }
+
+    /**
+     * Compute the sorted levels and the remapping of provisional codes.
+     * This should only be called once, after which the `Factorizer` should not be used.
+     *
+     * @return The sorted levels and the remapping from provisional to final codes.
+     */
+    FactorizerResults<Input_, Code_> finish() {
+        FactorizerResults<Input_, Code_> output;
+        output.levels = my_mapping.release();
+        output.remapping = sort_levels<Code_>(output.levels);
+        return output;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef FACTORIZE_FLAT_HASH_MAP_HPP
+#define FACTORIZE_FLAT_HASH_MAP_HPP
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "utils.hpp"
+
+/**
+ * @file FlatHashMap.hpp
+ * @brief Open-addressing hash table for factorization.
+ */
+
+namespace factorize {
+
+/**
+ * @cond
+ */
+namespace internal {
+
+// Finalizer from SplitMix64. This spreads out the bits of weak hashes,
+// e.g., the identity hash that most standard libraries use for integers.
+inline std::uint64_t mix_hash(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= UINT64_C(0xbf58476d1ce4e5b9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94d049bb133111eb);
+    x ^= x >> 31;
+    return x;
+}
+
+template<typename Key_>
+std::uint64_t hash_key(const Key_& key) {
+    return mix_hash(std::hash<Key_>()(key));
+}
+
+/*
+ * Linear probing hash table that assigns an index to each unique key in order of first insertion.
+ * Keys are stored contiguously in a single vector while the slots only hold (index + 1), with zero indicating an empty slot.
+ * This avoids the per-key allocation of node-based maps and keeps the probe sequence compact.
+ */
+template<typename Key_, typename Index_>
+class FlatHashMap {
+public:
+    FlatHashMap(const std::size_t expected) {
+        std::size_t capacity = 16;
+        while (capacity / 4 < expected) {
+            capacity *= 2;
+        }
+        sanisizer::resize(my_slots, capacity);
+        my_mask = capacity - 1;
+    }
+
+private:
+    // Slots hold (index + 1) so they need to be wider than Index_, otherwise the last index would wrap around to zero.
+    typedef std::size_t Slot;
+    std::vector<Slot> my_slots;
+    std::size_t my_mask;
+    std::vector<Key_> my_keys;
+
+    void grow() {
+        const auto capacity = sanisizer::product<I<decltype(my_slots.size())> >(my_slots.size(), 2);
+        std::vector<Slot> replacement(capacity);
+        const std::size_t mask = capacity - 1;
+        const auto nkeys = my_keys.size();
+        for (I<decltype(nkeys)> k = 0; k < nkeys; ++k) {
+            std::size_t pos = hash_key(my_keys[k]) & mask;
+            while (replacement[pos]) {
+                pos = (pos + 1) & mask;
+            }
+            replacement[pos] = k + 1;
+        }
+        my_slots.swap(replacement);
+        my_mask = mask;
+    }
+
+public:
+    // Returns the index of the key, and whether it was newly inserted.
+    std::pair<Index_, bool> insert(const Key_& key) {
+        // Keeping the load factor at or below 0.25 so that most lookups hit on the first probe.
+        // This costs a bit of memory but the slots are only one word each as they just hold indices.
+        if (my_keys.size() >= my_slots.size() / 4) {
+            grow();
+        }
+
+        std::size_t pos = hash_key(key) & my_mask;
+        while (true) {
+            const auto current = my_slots[pos];
+            if (current == 0) {
+                my_keys.push_back(key);
+                my_slots[pos] = my_keys.size();
+                return std::make_pair(static_cast<Index_>(my_keys.size() - 1), true);
+            }
+            if (my_keys[current - 1] == key) {
+                return std::make_pair(static_cast<Index_>(current - 1), false);
+            }
+            pos = (pos + 1) & my_mask;
+        }
+    }
+
+    std::size_t size() const {
+        return my_keys.size();
+    }
+
+    const std::vector<Key_>& keys() const {
+        return my_keys;
+    }
+
+    std::vector<Key_> release() {
+        return std::move(my_keys);
+    }
+};
+
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
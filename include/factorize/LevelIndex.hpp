@@ -0,0 +1,199 @@
+#ifndef FACTORIZE_LEVEL_INDEX_HPP
+#define FACTORIZE_LEVEL_INDEX_HPP
+
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+#include "sanisizer/sanisizer.hpp"
+#include "subpar/subpar.hpp"
+
+#include "utils.hpp"
+#include "create_factor.hpp"
+
+/**
+ * @file LevelIndex.hpp
+ * @brief Encode new observations against existing factor levels.
+ */
+
+namespace factorize {
+
+/**
+ * @brief Index of factor levels for fast encoding.
+ *
+ * This is used to encode new observations against a fixed set of levels, e.g., from a previous call to `create_factor()`,
+ * similar to R's `match()` function.
+ * For integer types where the range of levels is small, we use a direct lookup table spanning that range.
+ * Otherwise, we perform a branchless binary search on the levels in Eytzinger (i.e., breadth-first) order,
+ * which is more cache-friendly than a binary search on the sorted vector.
+ *
+ * @tparam Input_ Type of the categorical variable.
+ * This should be comparable with `<` and `==`.
+ * @tparam Code_ Integer type for the factor codes.
+ */
+template<typename Input_, typename Code_>
+class LevelIndex {
+public:
+    /**
+     * @param levels Vector of unique and sorted levels, e.g., as returned by `create_factor()`.
+     */
+    LevelIndex(const std::vector<Input_>& levels) : my_num_levels(levels.size()) {
+        if constexpr(internal::is_dense_candidate<Input_>()) {
+            if (!levels.empty()) {
+                const Unsigned lower = levels.front();
+                const Unsigned range = static_cast<Unsigned>(levels.back()) - lower;
+
+                // Using a lookup table if its size is comparable to the number of levels.
+                const std::uintmax_t limit = std::max<std::uintmax_t>(static_cast<std::uintmax_t>(my_num_levels) * 4, 4096);
+                if (static_cast<std::uintmax_t>(range) < limit) {
+                    my_direct = true;
+                    my_lower = lower;
+                    sanisizer::resize(my_table, sanisizer::sum<std::size_t>(range, 1));
+                    std::fill(my_table.begin(), my_table.end(), my_num_levels);
+                    for (I<decltype(my_num_levels)> l = 0; l < my_num_levels; ++l) {
+                        my_table[offset(levels[l])] = l;
+                    }
+                    return;
+                }
+            }
+        }
+
+        // Storing the levels in a 1-based Eytzinger layout, along with their positions in the sorted vector.
+        sanisizer::resize(my_tree, sanisizer::sum<std::size_t>(my_num_levels, 1));
+        sanisizer::resize(my_tree_codes, my_tree.size());
+        std::size_t counter = 0;
+        fill_tree(levels, counter, 1);
+    }
+
+private:
+    std::size_t my_num_levels;
+
+    typedef typename std::conditional<internal::is_dense_candidate<Input_>(), std::make_unsigned<Input_>, std::common_type<std::size_t> >::type::type Unsigned;
+    bool my_direct = false;
+    Unsigned my_lower = 0;
+    std::vector<std::size_t> my_table; // wider than Code_ so that 'my_num_levels' can be used to mark missing values, even if all values of Code_ are used.
+
+    std::vector<Input_> my_tree;
+    std::vector<Code_> my_tree_codes;
+
+    std::size_t offset(const Input_& x) const {
+        return static_cast<Unsigned>(static_cast<Unsigned>(x) - my_lower);
+    }
+
+    void fill_tree(const std::vector<Input_>& levels, std::size_t& counter, const std::size_t k) {
+        if (k <= my_num_levels) {
+            fill_tree(levels, counter, 2 * k);
+            my_tree[k] = levels[counter];
+            my_tree_codes[k] = counter;
+            ++counter;
+            fill_tree(levels, counter, 2 * k + 1);
+        }
+    }
+
+    // Backtracking to the last node where we went left, which contains the smallest level that is not less than 'x'.
+    Code_ resolve_search(std::size_t k, const Input_& x, const Code_ missing_code) const {
+        while (k & 1) {
+            k >>= 1;
+        }
+        k >>= 1;
+
+        if (k == 0 || !(my_tree[k] == x)) {
+            return missing_code;
+        }
+        return my_tree_codes[k];
+    }
+
+public:
+    /**
+     * @return Number of levels.
+     */
+    std::size_t size() const {
+        return my_num_levels;
+    }
+
+    /**
+     * @param x Value of the categorical variable.
+     * @param missing_code Code to return if `x` is not one of the levels.
+     * @return Position of `x` in the sorted levels, or `missing_code` if `x` is not present.
+     */
+    Code_ find(const Input_& x, const Code_ missing_code) const {
+        if constexpr(internal::is_dense_candidate<Input_>()) {
+            if (my_direct) {
+                if (x < static_cast<Input_>(my_lower)) {
+                    return missing_code;
+                }
+                const auto o = offset(x);
+                if (o >= my_table.size()) {
+                    return missing_code;
+                }
+                const auto code = my_table[o];
+                return (code == my_num_levels ? missing_code : static_cast<Code_>(code));
+            }
+        }
+
+        std::size_t k = 1;
+        while (k <= my_num_levels) {
+            k = 2 * k + (my_tree[k] < x);
+        }
+        return resolve_search(k, x, missing_code);
+    }
+
+    /**
+     * Encode multiple observations at once.
+     * For the binary search, observations are processed in batches where the searches for all observations in a batch are interleaved at each level of the tree.
+     * This allows the memory accesses for different observations to overlap, which is faster than calling `find()` on each observation when the levels do not fit in cache.
+     *
+     * @param n Number of observations.
+     * @param[in] input Pointer to an array of length `n` containing the categorical variable.
+     * @param[out] codes Pointer to an array of length `n` in which the codes are to be stored.
+     * On output, `codes[i]` contains the position of `input[i]` in the sorted levels, or `missing_code` if `input[i]` is not present.
+     * @param missing_code Code to use for observations that are not present in the levels.
+     * @param num_threads Number of threads to use.
+     */
+    void encode(const std::size_t n, const Input_* const input, Code_* const codes, const Code_ missing_code, const int num_threads = 1) const {
+        // Every search takes the same number of steps, i.e., the depth of the tree.
+        // Searches that would have stopped at the second-last level just go right at the last step, which is undone by the backtracking in resolve_search().
+        int depth = 0;
+        for (auto remaining = my_num_levels; remaining > 0; remaining >>= 1) {
+            ++depth;
+        }
+
+        subpar::parallelize_range(std::max(1, num_threads), n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+            if constexpr(internal::is_dense_candidate<Input_>()) {
+                if (my_direct) {
+                    for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+                        codes[i] = find(input[i], missing_code);
+                    }
+                    return;
+                }
+            }
+
+            constexpr std::size_t batch_size = 16;
+            std::array<std::size_t, batch_size> nodes;
+            for (I<decltype(length)> offset = 0; offset < length; offset += batch_size) {
+                const auto batch_input = input + start + offset;
+                const auto batch_codes = codes + start + offset;
+                const auto batch_length = std::min(batch_size, length - offset);
+
+                std::fill_n(nodes.begin(), batch_length, 1);
+                for (int d = 0; d < depth; ++d) {
+                    for (I<decltype(batch_length)> b = 0; b < batch_length; ++b) {
+                        const auto k = nodes[b];
+                        nodes[b] = 2 * k + (k > my_num_levels || my_tree[k] < batch_input[b]);
+                    }
+                }
+
+                for (I<decltype(batch_length)> b = 0; b < batch_length; ++b) {
+                    batch_codes[b] = resolve_search(nodes[b], batch_input[b], missing_code);
+                }
+            }
+        });
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef FACTORIZE_SPARSE_CARTESIAN_LEVELS_HPP
+#define FACTORIZE_SPARSE_CARTESIAN_LEVELS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "sanisizer/sanisizer.hpp"
+#include "subpar/subpar.hpp"
+
+#include "CartesianLevels.hpp"
+#include "utils.hpp"
+
+/**
+ * @file SparseCartesianLevels.hpp
+ * @brief Observed subset of the levels of a Cartesian product of factors.
+ */
+
+namespace factorize {
+
+/**
+ * @brief Observed subset of the levels of a Cartesian product of factors.
+ *
+ * This describes a sorted subset of the combinations in a Cartesian product of factors, e.g., as computed by `combine_to_factor_unused_sparse()`.
+ * Each combination in the subset is identified by its position in the full product (i.e., its "key"), as defined by a `CartesianLevels` instance with 64-bit codes.
+ * The combined code of each combination is then defined as the rank of its key among the keys of the subset.
+ * This allows the combined codes to respect the ordering of the full product while only requiring `Code_` to hold the number of combinations in the subset.
+ *
+ * @tparam Code_ Integer type for the combined codes.
+ * This should be large enough to hold the number of combinations in the subset.
+ */
+template<typename Code_>
+class SparseCartesianLevels {
+public:
+    /**
+     * Default constructor, equivalent to an empty subset of a product of zero factors.
+     */
+    SparseCartesianLevels() = default;
+
+    /**
+     * @param space Description of the full Cartesian product.
+     * @param keys Sorted and unique positions of the combinations of interest in `space`, i.e., each entry should be less than `space.size()`.
+     */
+    SparseCartesianLevels(CartesianLevels<std::uint64_t> space, std::vector<std::uint64_t> keys) : my_space(std::move(space)), my_keys(std::move(keys)) {
+        sanisizer::cast<Code_>(my_keys.size());
+    }
+
+private:
+    CartesianLevels<std::uint64_t> my_space;
+    std::vector<std::uint64_t> my_keys;
+
+public:
+    /**
+     * @return Number of factors.
+     */
+    std::size_t num_variables() const {
+        return my_space.num_variables();
+    }
+
+    /**
+     * @return Number of combinations in the subset.
+     */
+    Code_ size() const {
+        return my_keys.size();
+    }
+
+    /**
+     * @return Description of the full Cartesian product.
+     */
+    const CartesianLevels<std::uint64_t>& space() const {
+        return my_space;
+    }
+
+    /**
+     * @return Sorted positions of the combinations of the subset in the full product.
+     * The combined code of each combination is equal to its index in this vector.
+     */
+    const std::vector<std::uint64_t>& keys() const {
+        return my_keys;
+    }
+
+    /**
+     * @param code Combined code, less than `size()`.
+     * @return Position of the corresponding combination in the full product.
+     */
+    std::uint64_t key(const Code_ code) const {
+        return my_keys[code];
+    }
+
+    /**
+     * @param key Position of a combination in the full product.
+     * @param missing Value to return if the combination is not part of the subset.
+     * @return Combined code for `key`, or `missing` if `key` is not part of the subset.
+     */
+    Code_ find(const std::uint64_t key, const Code_ missing) const {
+        const auto it = std::lower_bound(my_keys.begin(), my_keys.end(), key);
+        if (it == my_keys.end() || *it != key) {
+            return missing;
+        }
+        return it - my_keys.begin();
+    }
+
+    /**
+     * @param f Index of the factor.
+     * @param code Combined code, less than `size()`.
+     * @return Code of factor `f` in the combination corresponding to `code`.
+     */
+    std::uint64_t level(const std::size_t f, const Code_ code) const {
+        return my_space.level(f, my_keys[code]);
+    }
+
+    /**
+     * Decode combined codes into the codes of a single factor.
+     *
+     * @tparam Level_ Integer type for the per-factor codes.
+     * @param f Index of the factor.
+     * @param n Number of observations.
+     * @param[in] codes Pointer to an array of length `n` containing the combined codes.
+     * @param[out] levels Pointer to an array of length `n` in which to store the codes for factor `f`.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Level_>
+    void decode(const std::size_t f, const std::size_t n, const Code_* const codes, Level_* const levels, const int num_threads = 1) const {
+        decode_tiles(n, codes, num_threads, [&](const std::size_t start, const std::size_t length, const std::uint64_t* const keys) -> void {
+            my_space.decode(f, length, keys, levels + start);
+        });
+    }
+
+    /**
+     * Decode combined codes into the codes of all factors.
+     *
+     * @tparam Level_ Integer type for the per-factor codes.
+     * @param n Number of observations.
+     * @param[in] codes Pointer to an array of length `n` containing the combined codes.
+     * @param[out] levels Vector of length equal to `num_variables()`.
+     * Each entry is a pointer to an array of length `n` in which to store the codes for the corresponding factor.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Level_>
+    void decode(const std::size_t n, const Code_* const codes, const std::vector<Level_*>& levels, const int num_threads = 1) const {
+        const auto nvariables = num_variables();
+        decode_tiles(n, codes, num_threads, [&](const std::size_t start, const std::size_t length, const std::uint64_t* const keys) -> void {
+            auto offset_levels = levels;
+            for (I<decltype(nvariables)> f = 0; f < nvariables; ++f) {
+                offset_levels[f] += start;
+            }
+            my_space.decode(length, keys, offset_levels);
+        });
+    }
+
+private:
+    template<class Decode_>
+    void decode_tiles(const std::size_t n, const Code_* const codes, const int num_threads, Decode_ decode) const {
+        subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+            constexpr std::size_t tile_size = 4096;
+            std::vector<std::uint64_t> keys(std::min(tile_size, length));
+            for (I<decltype(length)> offset = 0; offset < length; offset += tile_size) {
+                const auto tile_start = start + offset;
+                const auto tile_length = std::min(tile_size, length - offset);
+                for (I<decltype(tile_length)> i = 0; i < tile_length; ++i) {
+                    keys[i] = my_keys[codes[tile_start + i]];
+                }
+                decode(tile_start, tile_length, keys.data());
+            }
+        });
+    }
+
+public:
+    /**
+     * Materialize the levels of all combinations in the subset.
+     *
+     * @tparam Level_ Type of the levels.
+     * This should be constructible from `std::uint64_t`.
+     * @param num_threads Number of threads to use.
+     * @return Vector of length equal to `num_variables()`, where each inner vector has length equal to `size()`.
+     * For each combined code `c`, the code of factor `f` is stored in `output[f][c]`.
+     */
+    template<typename Level_>
+    std::vector<std::vector<Level_> > materialize(const int num_threads = 1) const {
+        const auto nvariables = num_variables();
+        auto output = sanisizer::create<std::vector<std::vector<Level_> > >(nvariables);
+        for (I<decltype(nvariables)> f = 0; f < nvariables; ++f) {
+            output[f].resize(my_keys.size());
+            my_space.decode(f, my_keys.size(), my_keys.data(), output[f].data(), num_threads);
+        }
+        return output;
+    }
+};
+
+}
+
+#endif
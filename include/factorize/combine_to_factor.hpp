@@ -4,12 +4,27 @@
 #include <algorithm>
 #include <vector>
 #include <map>
+#include <queue>
 #include <unordered_map>
+#include <numeric>
+#include <limits>
+#include <type_traits>
+#include <functional>
+#include <tuple>
+#include <array>
+#include <stdexcept>
+#include <atomic>
+#include <utility>
 #include <cstddef>
+#include <cstdint>
 
 #include "sanisizer/sanisizer.hpp"
 
 #include "create_factor.hpp"
+#include "CartesianLevels.hpp"
+#include "SparseCartesianLevels.hpp"
+#include "FlatHashMap.hpp"
+#include "radix_sort.hpp"
 #include "utils.hpp"
 
 /**
@@ -20,111 +35,1836 @@
 namespace factorize {
 
 /**
+ * Strategy for identifying the unique combinations in `combine_to_factor()`.
+ *
+ * - `MIXED_RADIX`: convert each variable into a factor, combine the per-variable codes into a single integer key for each observation, and factorize the keys.
+ *   This is efficient when the number of unique combinations is much smaller than the number of observations.
+ * - `SORT`: sort a permutation of the observations by each variable, and read off the unique combinations from runs of identical values.
+ *   This does not allocate any memory per unique combination, which is useful when most combinations are unique.
+ *   Integer and IEEE floating-point variables are radix sorted, otherwise a comparison-based stable sort is used.
+ * - `HASH`: compute a hash of all variables for each observation, build a hash table of the unique combinations, and then sort the unique combinations.
+ *   This avoids factorizing each variable separately, which is faster when the number of unique combinations is much smaller than the number of observations.
+ *   Only applicable if `Input_` is hashable, otherwise `MIXED_RADIX` is used instead.
+ */
+enum class CombineToFactorStrategy : char { MIXED_RADIX, SORT, HASH };
+
+/**
+ * @brief Options for `combine_to_factor()`.
+ */
+struct CombineToFactorOptions {
+    /**
+     * Strategy for identifying the unique combinations.
+     * Regardless of the choice here, integer inputs with small ranges are always handled with a lookup table, see `combine_to_factor()` for details.
+     */
+    CombineToFactorStrategy strategy = CombineToFactorStrategy::MIXED_RADIX;
+
+    /**
+     * Whether to detect variables that are nested within another variable, i.e., each level of the nested variable is fully determined by the level of the other variable.
+     * If true, each variable is first converted into a factor with `create_factor()`, nested variables are identified from the per-variable codes, 
+     * and only the remaining variables are combined with the mixed-radix approach (regardless of `strategy`).
+     * This should be enabled if some variables are likely to be nested, e.g., lanes within runs or samples within donors;
+     * otherwise, it just adds an extra pass over the codes of each variable, which is usually short-circuited by the first inconsistency.
+     * Only used if `Input_` is hashable and there are at least two variables.
+     */
+    bool detect_nested = false;
+
+    /**
+     * Number of threads to use.
+     * The output is the same regardless of the number of threads.
+     * This is currently ignored for `CombineToFactorStrategy::SORT`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+// Assigns provisional codes in order of first appearance of each combination.
+// Returns the index of the first occurrence and the provisional code for each unique combination, in lexicographic order.
+template<typename Input_, typename Code_>
+std::vector<std::pair<std::size_t, Code_> > combine_to_factor_map(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes) {
+    struct Combination {
+        Combination(const std::size_t i) : index(i) {}
+        std::size_t index;
+    };
+
+    // Using a map with a custom comparator that uses the index
+    // of first occurrence of each factor as the key. Currently using a map
+    // to (i) avoid issues with collisions of combined hashes and (ii)
+    // avoid having to write more code for sorting a vector of arrays.
+    auto cmp = [&](const Combination& left, const Combination& right) -> bool {
+        for (auto curf : inputs) {
+            if (curf[left.index] < curf[right.index]) {
+                return true;
+            } else if (curf[left.index] > curf[right.index]) {
+                return false;
+            }
+        }
+        return false;
+    };
+    std::map<Combination, Code_, I<decltype(cmp)> > mapping(std::move(cmp));
+
+    const auto eq = [&](const Combination& left, const Combination& right) -> bool {
+        for (auto curf : inputs) {
+            if (curf[left.index] != curf[right.index]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (I<decltype(n)> i = 0; i < n; ++i) {
+        Combination current(i);
+        const auto mIt = mapping.find(current);
+        if (mIt == mapping.end() || !eq(mIt->first, current)) {
+            Code_ alt = mapping.size();
+            mapping.insert(mIt, std::make_pair(current, alt));
+            codes[i] = alt;
+        } else {
+            codes[i] = mIt->second;
+        }
+    }
+
+    std::vector<std::pair<std::size_t, Code_> > output;
+    output.reserve(mapping.size());
+    for (const auto& m : mapping) {
+        output.emplace_back(m.first.index, m.second);
+    }
+    return output;
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Input_>
+constexpr bool is_hashable() {
+    return std::is_default_constructible<std::hash<Input_> >::value;
+}
+
+struct MixedRadixKeys {
+    std::vector<std::uint64_t> keys;
+    std::vector<std::uint64_t> buffer;
+    std::uint64_t ncombos = 1;
+    std::vector<std::size_t> nlevels;
+
+    // Each compaction is defined by the index of the first variable folded into the compacted keys,
+    // along with the sorted unique keys before compaction, such that the compacted key is an index into this vector.
+    std::vector<std::pair<std::size_t, std::vector<std::uint64_t> > > compactions;
+};
+
+inline void initialize_mixed_radix_keys(const std::size_t n, MixedRadixKeys& store) {
+    sanisizer::resize(store.keys, n);
+    sanisizer::resize(store.buffer, n);
+}
+
+// Folds the codes of the next variable (stored in 'store.buffer' by the caller) into the mixed-radix integer key for each observation.
+// As the levels of each variable are sorted, the order of the keys is the same as the lexicographic order of the combinations.
+// If the product of the number of levels would overflow, we compact the existing keys by factorizing them before folding in the next variable.
+// Returns false if the keys cannot be represented even after compaction, i.e., for more than 2^32 observations.
+inline bool fold_mixed_radix_keys(const std::size_t n, const std::size_t nlevels, const int num_threads, MixedRadixKeys& store) {
+    const auto f = store.nlevels.size();
+    store.nlevels.push_back(nlevels);
+    if (f == 0) {
+        store.keys.swap(store.buffer);
+        store.ncombos = nlevels;
+        return true;
+    }
+    if (nlevels == 0) { // only possible if n == 0.
+        return true;
+    }
+
+    constexpr std::uint64_t maxed = std::numeric_limits<std::uint64_t>::max();
+    const std::uint64_t nlevels64 = nlevels;
+    if (store.ncombos > maxed / nlevels64) {
+        // Codes from create_factor() respect the ordering of the keys, so the lexicographic order is still preserved after compaction.
+        CreateFactorOptions fopt;
+        fopt.num_threads = num_threads;
+        std::vector<std::uint64_t> compacted(n);
+        auto uniq = create_factor(n, store.keys.data(), compacted.data(), fopt, NULL);
+        if (uniq.size() > maxed / nlevels64) {
+            return false;
+        }
+        store.ncombos = uniq.size();
+        store.keys.swap(compacted);
+        store.compactions.emplace_back(f, std::move(uniq));
+    }
+
+    subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+            store.keys[i] = store.keys[i] * nlevels64 + store.buffer[i];
+        }
+    });
+    store.ncombos *= nlevels64;
+    return true;
+}
+
+template<typename Input_>
+bool fold_mixed_radix_keys(const std::size_t n, const std::vector<const Input_*>& inputs, const int num_threads, MixedRadixKeys& store, std::vector<std::vector<Input_> >& levels) {
+    const auto ninputs = inputs.size();
+    sanisizer::resize(levels, ninputs);
+    initialize_mixed_radix_keys(n, store);
+
+    CreateFactorOptions fopt;
+    fopt.num_threads = num_threads;
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        levels[f] = create_factor(n, inputs[f], store.buffer.data(), fopt, NULL);
+        if (!fold_mixed_radix_keys(n, levels[f].size(), num_threads, store)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Folds the precomputed codes of the chosen variables into the mixed-radix keys, e.g., if the per-variable factors are also needed elsewhere.
+template<typename Input_, typename Code_>
+bool fold_mixed_radix_codes(const std::size_t n, const std::vector<std::vector<Input_> >& levels, const std::vector<std::vector<Code_> >& level_codes, const std::vector<std::size_t>& chosen, const int num_threads, MixedRadixKeys& store) {
+    initialize_mixed_radix_keys(n, store);
+    for (auto f : chosen) {
+        std::copy(level_codes[f].begin(), level_codes[f].end(), store.buffer.begin());
+        if (!fold_mixed_radix_keys(n, levels[f].size(), num_threads, store)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Decodes each unique key into the corresponding combination of per-variable codes.
+inline std::vector<std::vector<std::size_t> > decode_mixed_radix_keys(const std::vector<std::uint64_t>& unique_keys, const MixedRadixKeys& store) {
+    const auto ninputs = store.nlevels.size();
+    const auto nuniq = unique_keys.size();
+    auto output = sanisizer::create<std::vector<std::vector<std::size_t> > >(ninputs);
+    for (auto& ofac : output) {
+        sanisizer::resize(ofac, nuniq);
+    }
+
+    const auto peel = [&](std::uint64_t& key, const I<decltype(nuniq)> u, const std::size_t f) -> void {
+        const std::uint64_t nlevels = store.nlevels[f];
+        output[f][u] = key % nlevels;
+        key /= nlevels;
+    };
+
+    for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+        auto key = unique_keys[u];
+        auto f = ninputs;
+        for (auto c = store.compactions.size(); c > 0; --c) {
+            const auto& comp = store.compactions[c - 1];
+            for (; f > comp.first; --f) {
+                peel(key, u, f - 1);
+            }
+            key = comp.second[key];
+        }
+        for (; f > 1; --f) {
+            peel(key, u, f - 1);
+        }
+        output[0][u] = key;
+    }
+
+    return output;
+}
+
+template<typename Input_>
+std::vector<std::vector<Input_> > decode_mixed_radix_levels(const std::vector<std::uint64_t>& unique_keys, const MixedRadixKeys& store, const std::vector<std::vector<Input_> >& levels) {
+    const auto level_codes = decode_mixed_radix_keys(unique_keys, store);
+    const auto ninputs = levels.size();
+    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        const auto& curcodes = level_codes[f];
+        const auto& curlevels = levels[f];
+        auto& curout = output[f];
+        curout.reserve(curcodes.size());
+        for (auto c : curcodes) {
+            curout.push_back(curlevels[c]);
+        }
+    }
+    return output;
+}
+
+// For small-range integers, the observed combinations are directly identified from a presence array spanning the Cartesian product of ranges.
+// Returns false if the product is larger than 'n', to avoid allocating a lot of memory for a few sparse combinations.
+template<typename Input_, typename Code_>
+bool combine_to_factor_dense(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, std::vector<std::vector<Input_> >& output, const int num_threads, FactorSummary* const summary) {
+    typedef typename std::make_unsigned<Input_>::type Unsigned;
+    const auto ninputs = inputs.size();
+    auto lower = sanisizer::create<std::vector<Unsigned> >(ninputs);
+    auto spans = sanisizer::create<std::vector<std::size_t> >(ninputs);
+
+    std::size_t ncombos = 1;
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        if (!find_dense_range(n, inputs[f], num_threads, lower[f], spans[f])) {
+            return false;
+        }
+        if (ncombos > n / spans[f]) {
+            return false;
+        }
+        ncombos *= spans[f];
+    }
+
+    // Using the same key as in combine_to_factor_unused(), where the first variable is the slowest changing.
+    const auto key = [&](const std::size_t i) -> std::size_t {
+        std::size_t current = 0;
+        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+            current = current * spans[f] + static_cast<Unsigned>(static_cast<Unsigned>(inputs[f][i]) - lower[f]);
+        }
+        return current;
+    };
+
+    const auto present = find_present_offsets(n, ncombos, num_threads, key);
+
+    // Prefix sum to compact the observed combinations, walking through the per-variable offsets like an odometer.
+    auto lookup = sanisizer::create<std::vector<Code_> >(ncombos);
+    auto offsets = sanisizer::create<std::vector<std::size_t> >(ninputs);
+    const auto nuniq = std::count(present.begin(), present.end(), 1);
+    for (auto& ofac : output) {
+        ofac.reserve(nuniq);
+    }
+
+    Code_ counter = 0;
+    for (I<decltype(ncombos)> c = 0; c < ncombos; ++c) {
+        if (present[c]) {
+            lookup[c] = counter;
+            ++counter;
+            for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+                output[f].push_back(static_cast<Input_>(static_cast<Unsigned>(lower[f] + offsets[f])));
+            }
+        }
+
+        for (auto f = ninputs; f > 0; --f) {
+            auto& curoff = offsets[f - 1];
+            ++curoff;
+            if (curoff < spans[f - 1]) {
+                break;
+            }
+            curoff = 0;
+        }
+    }
+
+    if (summary) {
+        resize_summary(*summary, nuniq);
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            const auto code = lookup[key(i)];
+            codes[i] = code;
+            add_to_summary(*summary, code, i);
+        }
+    } else {
+        subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+            for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+                codes[i] = lookup[key(i)];
+            }
+        });
+    }
+
+    return true;
+}
+
+// Sorts a permutation of the observations by each variable in turn, from the last to the first.
+// As each sort is stable, the final permutation is in lexicographic order of the combinations.
+template<typename Index_, typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor_sort(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, FactorSummary* const summary) {
+    const auto ninputs = inputs.size();
+    auto indices = sanisizer::create<std::vector<Index_> >(n);
+    std::iota(indices.begin(), indices.end(), static_cast<Index_>(0));
+
+    if constexpr(is_radix_sortable<Input_>()) {
+        typedef typename RadixKey<Input_>::Type Key;
+        auto keys = sanisizer::create<std::vector<Key> >(n);
+        std::vector<Key> key_buffer;
+        std::vector<Index_> index_buffer;
+        for (auto f = ninputs; f > 0; --f) {
+            const auto curf = inputs[f - 1];
+            for (I<decltype(n)> i = 0; i < n; ++i) {
+                keys[i] = to_radix_key(curf[indices[i]]);
+            }
+            radix_sort(keys, indices, key_buffer, index_buffer);
+        }
+    } else {
+        for (auto f = ninputs; f > 0; --f) {
+            const auto curf = inputs[f - 1];
+            std::stable_sort(indices.begin(), indices.end(), [&](const Index_ left, const Index_ right) -> bool {
+                return curf[left] < curf[right];
+            });
+        }
+    }
+
+    const auto same = [&](const std::size_t left, const std::size_t right) -> bool {
+        for (auto curf : inputs) {
+            if constexpr(is_radix_sortable<Input_>()) {
+                if (to_radix_key(curf[left]) != to_radix_key(curf[right])) {
+                    return false;
+                }
+            } else {
+                if (curf[left] < curf[right] || curf[right] < curf[left]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    // Walking through the sorted permutation to identify the unique combinations and scatter their codes.
+    // As the sorts are stable, the indices within each run of identical combinations are in increasing order.
+    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    Code_ counter = 0;
+    if (summary) {
+        resize_summary(*summary, 0);
+    }
+    for (I<decltype(n)> i = 0; i < n; ++i) {
+        const std::size_t current = indices[i];
+        if (i == 0 || !same(indices[i - 1], current)) {
+            if (i) {
+                ++counter;
+            }
+            for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+                output[f].push_back(inputs[f][current]);
+            }
+            if (summary) {
+                summary->counts.push_back(0);
+                summary->first.push_back(current);
+                summary->last.push_back(current);
+            }
+        }
+        codes[current] = counter;
+        if (summary) {
+            ++(summary->counts.back());
+            summary->last.back() = current;
+        }
+    }
+
+    return output;
+}
+
+// Given the first occurrence and provisional code of each unique combination in lexicographic order,
+// this extracts the combined levels and remaps the provisional codes to their sorted counterparts.
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > remap_to_sorted_combinations(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const std::vector<std::pair<std::size_t, Code_> >& unique, FactorSummary* const summary) {
+    const auto ninputs = inputs.size();
+    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    const auto nuniq = unique.size();
+    for (auto& ofac : output) {
+        ofac.reserve(nuniq);
+    }
+    auto remapping = sanisizer::create<std::vector<Code_> >(nuniq);
+    for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+        const auto ix = unique[u].first;
+        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+            output[f].push_back(inputs[f][ix]);
+        }
+        remapping[unique[u].second] = u;
+    }
+
+    // Mapping each cell to its sorted combination.
+    if (summary) {
+        resize_summary(*summary, nuniq);
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            const auto code = remapping[codes[i]];
+            codes[i] = code;
+            add_to_summary(*summary, code, i);
+        }
+    } else {
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            codes[i] = remapping[codes[i]];
+        }
+    }
+
+    return output;
+}
+
+// Fallback for non-hashable types or if the mixed-radix keys cannot be constructed.
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor_map_sorted(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, FactorSummary* const summary) {
+    const auto unique = combine_to_factor_map(n, inputs, codes);
+    return remap_to_sorted_combinations(n, inputs, codes, unique, summary);
+}
+
+// Computes a hash of all variables for each observation in [start, start + length), processing one variable at a time.
+// There are no dependencies between iterations of the inner loop, so the compiler is free to vectorize the mixing.
+template<typename Input_>
+void hash_combinations(const std::vector<const Input_*>& inputs, const std::size_t start, const std::size_t length, std::uint64_t* const hashes) {
+    std::fill_n(hashes, length, 0);
+    for (auto curf : inputs) {
+        const auto ptr = curf + start;
+        for (I<decltype(length)> l = 0; l < length; ++l) {
+            const auto current = hashes[l];
+            hashes[l] = ((current << 5 | current >> 59) ^ static_cast<std::uint64_t>(std::hash<Input_>()(ptr[l]))) * UINT64_C(0x9e3779b97f4a7c15);
+        }
+    }
+    for (I<decltype(length)> l = 0; l < length; ++l) {
+        hashes[l] = mix_hash(hashes[l]);
+    }
+}
+
+// Assigns block-specific codes in order of first appearance, returning the representative (i.e., first occurrence) of each unique combination in the same order.
+// This uses a linear probing hash table where each slot stores the hash of a unique combination and its block-specific code (plus 1, with zero indicating an empty slot).
+// The full comparison is only performed when the hashes are equal.
+// If 'summary' is provided, it is filled with the summaries for each block-specific code.
+template<typename Input_, typename Code_>
+std::vector<std::size_t> hash_combination_block(const std::vector<const Input_*>& inputs, Code_* const codes, const std::size_t start, const std::size_t length, FactorSummary* const summary) {
+    // Starting with a modest table and letting it grow, as low-cardinality inputs would not benefit from a large table.
+    std::vector<std::uint64_t> slot_hashes(16);
+    std::vector<std::size_t> slot_codes(16);
+    std::size_t mask = 15;
+    std::vector<std::size_t> representatives;
+
+    const auto equals = [&](const std::size_t left, const std::size_t right) -> bool {
+        for (auto curf : inputs) {
+            if (!(curf[left] == curf[right])) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const auto grow = [&]() -> void {
+        const auto capacity = sanisizer::product<I<decltype(slot_hashes.size())> >(slot_hashes.size(), 2);
+        std::vector<std::uint64_t> replacement_hashes(capacity);
+        std::vector<std::size_t> replacement_codes(capacity);
+        const std::size_t new_mask = capacity - 1;
+        for (I<decltype(slot_hashes.size())> s = 0, end = slot_hashes.size(); s < end; ++s) {
+            if (slot_codes[s]) {
+                std::size_t pos = slot_hashes[s] & new_mask;
+                while (replacement_codes[pos]) {
+                    pos = (pos + 1) & new_mask;
+                }
+                replacement_hashes[pos] = slot_hashes[s];
+                replacement_codes[pos] = slot_codes[s];
+            }
+        }
+        slot_hashes.swap(replacement_hashes);
+        slot_codes.swap(replacement_codes);
+        mask = new_mask;
+    };
+
+    constexpr std::size_t chunk_size = 4096;
+    std::vector<std::uint64_t> hashes(std::min(length, chunk_size));
+    for (I<decltype(length)> offset = 0; offset < length; offset += chunk_size) {
+        const auto chunk_start = start + offset;
+        const auto chunk_length = std::min(chunk_size, length - offset);
+        hash_combinations(inputs, chunk_start, chunk_length, hashes.data());
+
+        for (I<decltype(chunk_length)> l = 0; l < chunk_length; ++l) {
+            // Keeping the load factor at or below 0.25, see FlatHashMap for the rationale.
+            if (representatives.size() >= slot_hashes.size() / 4) {
+                grow();
+            }
+
+            const auto h = hashes[l];
+            const auto i = chunk_start + l;
+            std::size_t pos = h & mask;
+            while (true) {
+                const auto current = slot_codes[pos];
+                if (current == 0) {
+                    representatives.push_back(i);
+                    slot_hashes[pos] = h;
+                    slot_codes[pos] = representatives.size();
+                    codes[i] = representatives.size() - 1;
+                    if (summary) {
+                        summary->counts.push_back(0);
+                        summary->first.push_back(i);
+                        summary->last.push_back(i);
+                    }
+                    break;
+                }
+                if (slot_hashes[pos] == h && equals(representatives[current - 1], i)) {
+                    codes[i] = current - 1;
+                    break;
+                }
+                pos = (pos + 1) & mask;
+            }
+
+            if (summary) {
+                add_to_summary(*summary, codes[i], i);
+            }
+        }
+    }
+
+    return representatives;
+}
+
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor_hash(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const int num_threads, FactorSummary* const summary) {
+    const auto less = [&](const std::size_t left, const std::size_t right) -> bool {
+        for (auto curf : inputs) {
+            if (curf[left] < curf[right]) {
+                return true;
+            } else if (curf[right] < curf[left]) {
+                return false;
+            }
+        }
+        return false;
+    };
+
+    // Each thread builds its own table for a contiguous block of observations, assigning block-specific codes.
+    // Only the unique combinations of each block are then sorted into lexicographic order.
+    std::vector<std::vector<std::pair<std::size_t, Code_> > > block_unique(num_threads);
+    std::vector<std::pair<std::size_t, std::size_t> > block_ranges(num_threads);
+    std::vector<FactorSummary> block_summaries(summary ? num_threads : 0);
+    subpar::parallelize_range(num_threads, n, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+        block_ranges[t] = std::make_pair(start, length);
+        const auto representatives = hash_combination_block(inputs, codes, start, length, (summary ? block_summaries.data() + t : NULL));
+        const auto nlocal = representatives.size();
+        auto& unique = block_unique[t];
+        unique.reserve(nlocal);
+        for (I<decltype(nlocal)> l = 0; l < nlocal; ++l) {
+            unique.emplace_back(representatives[l], l);
+        }
+        std::sort(unique.begin(), unique.end(), [&](const std::pair<std::size_t, Code_>& left, const std::pair<std::size_t, Code_>& right) -> bool {
+            return less(left.first, right.first);
+        });
+    });
+
+    // Merging the sorted combinations across blocks, and filling each block's remapping from block-specific to sorted codes.
+    // Ties are broken by block so that each combination is represented by its first occurrence, regardless of the number of threads.
+    typedef std::pair<int, std::size_t> Cursor;
+    auto cmp = [&](const Cursor& left, const Cursor& right) -> bool {
+        const auto lrep = block_unique[left.first][left.second].first;
+        const auto rrep = block_unique[right.first][right.second].first;
+        if (less(rrep, lrep)) {
+            return true;
+        } else if (less(lrep, rrep)) {
+            return false;
+        }
+        return right.first < left.first;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, I<decltype(cmp)> > heap(std::move(cmp));
+    std::vector<std::vector<Code_> > block_remapping(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        const auto& unique = block_unique[t];
+        sanisizer::resize(block_remapping[t], unique.size());
+        if (!unique.empty()) {
+            heap.emplace(t, 0);
+        }
+    }
+
+    const auto ninputs = inputs.size();
+    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    std::size_t last_rep = 0;
+    while (!heap.empty()) {
+        const auto current = heap.top();
+        heap.pop();
+        const auto& entry = block_unique[current.first][current.second];
+        if (output.front().empty() || less(last_rep, entry.first)) {
+            last_rep = entry.first;
+            for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+                output[f].push_back(inputs[f][last_rep]);
+            }
+        }
+        block_remapping[current.first][entry.second] = output.front().size() - 1;
+        const auto next = current.second + 1;
+        if (next < block_unique[current.first].size()) {
+            heap.emplace(current.first, next);
+        }
+    }
+
+    if (summary) {
+        merge_block_summaries(block_remapping, block_summaries, output.front().size(), *summary);
+    }
+
+    // Mapping each cell to its sorted combination.
+    remap_blocks(codes, block_ranges, block_remapping, 0, num_threads);
+    return output;
+}
+
+// Checks whether the 'child' variable is fully determined by the 'parent' variable.
+// If so, 'mapping' contains the level of the child for each level of the parent.
+template<typename Code_>
+bool is_nested_within(const std::size_t n, const Code_* const child, const Code_* const parent, const std::size_t nparent, std::vector<Code_>& mapping) {
+    // Levels of the child are always less than the maximum as there cannot be more levels than the number of unique combinations.
+    constexpr Code_ unset = std::numeric_limits<Code_>::max();
+    mapping.clear();
+    mapping.resize(nparent, unset);
+    for (I<decltype(n)> i = 0; i < n; ++i) {
+        auto& current = mapping[parent[i]];
+        if (current == unset) {
+            current = child[i];
+        } else if (current != child[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Combines all variables after dropping those that are nested within another variable.
+// Returns false if the mixed-radix keys of the remaining variables overflow, in which case nothing is reported in 'nested'.
+// 'levels' and 'level_codes' should contain the factor for each variable, e.g., from create_factor().
+// If 'mapping' is provided, it is filled with the code of each variable for each combined code, see CombineToFactorMarginals::mapping.
+template<typename Input_, typename Code_>
+bool combine_to_factor_nested(
+    const std::size_t n,
+    const std::vector<std::vector<Input_> >& levels,
+    const std::vector<std::vector<Code_> >& level_codes,
+    Code_* const codes,
+    const int num_threads,
+    FactorSummary* const summary,
+    std::vector<std::vector<Input_> >& output,
+    std::vector<std::pair<std::size_t, std::size_t> >* const nested,
+    std::vector<std::vector<Code_> >* const mapping)
+{
+    const auto ninputs = levels.size();
+
+    // A variable can only be nested within another variable with at least as many levels, so we consider the variables with more levels first.
+    // Each variable is only compared to the retained variables, which is sufficient as nesting is transitive.
+    auto order = sanisizer::create<std::vector<std::size_t> >(ninputs);
+    std::iota(order.begin(), order.end(), static_cast<std::size_t>(0));
+    std::stable_sort(order.begin(), order.end(), [&](const std::size_t left, const std::size_t right) -> bool { return levels[left].size() > levels[right].size(); });
+
+    std::vector<std::size_t> retained;
+    auto parents = sanisizer::create<std::vector<std::size_t> >(ninputs);
+    std::fill(parents.begin(), parents.end(), ninputs); // i.e., no parent.
+    auto parent_mappings = sanisizer::create<std::vector<std::vector<Code_> > >(ninputs);
+    for (auto f : order) {
+        for (auto g : retained) {
+            if (is_nested_within(n, level_codes[f].data(), level_codes[g].data(), levels[g].size(), parent_mappings[f])) {
+                parents[f] = g;
+                break;
+            }
+        }
+        if (parents[f] == ninputs) {
+            retained.push_back(f);
+        }
+    }
+    std::sort(retained.begin(), retained.end());
+
+    MixedRadixKeys store;
+    if (!fold_mixed_radix_codes(n, levels, level_codes, retained, num_threads, store)) {
+        return false;
+    }
+    CreateFactorOptions fopt;
+    fopt.num_threads = num_threads;
+    const auto unique_keys = create_factor(n, store.keys.data(), codes, fopt, summary);
+    const auto retained_codes = decode_mixed_radix_keys(unique_keys, store);
+
+    // Filling in the level codes of each nested variable from its parent.
+    const auto nuniq = unique_keys.size();
+    auto combined_codes = sanisizer::create<std::vector<std::vector<Code_> > >(ninputs);
+    const auto nretained = retained.size();
+    for (I<decltype(nretained)> r = 0; r < nretained; ++r) {
+        combined_codes[retained[r]].assign(retained_codes[r].begin(), retained_codes[r].end());
+    }
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        if (parents[f] != ninputs) {
+            const auto& mapping = parent_mappings[f];
+            const auto& parent_codes = combined_codes[parents[f]];
+            auto& curcodes = combined_codes[f];
+            curcodes.reserve(nuniq);
+            for (auto p : parent_codes) {
+                curcodes.push_back(mapping[p]);
+            }
+        }
+    }
+
+    // The combinations are sorted by the retained variables, but we need them to be sorted by all variables.
+    // This only needs reordering if a nested variable comes before its parent.
+    const auto less = [&](const std::size_t left, const std::size_t right) -> bool {
+        for (const auto& curcodes : combined_codes) {
+            if (curcodes[left] != curcodes[right]) {
+                return curcodes[left] < curcodes[right];
+            }
+        }
+        return false;
+    };
+    auto permutation = sanisizer::create<std::vector<std::size_t> >(nuniq);
+    std::iota(permutation.begin(), permutation.end(), static_cast<std::size_t>(0));
+    if (!std::is_sorted(permutation.begin(), permutation.end(), less)) {
+        std::sort(permutation.begin(), permutation.end(), less);
+        auto remapping = sanisizer::create<std::vector<Code_> >(nuniq);
+        for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+            remapping[permutation[u]] = u;
+        }
+        subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+            for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+                codes[i] = remapping[codes[i]];
+            }
+        });
+
+        if (summary) {
+            FactorSummary original;
+            original.counts.swap(summary->counts);
+            original.first.swap(summary->first);
+            original.last.swap(summary->last);
+            resize_summary(*summary, nuniq);
+            for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+                const auto p = permutation[u];
+                summary->counts[u] = original.counts[p];
+                summary->first[u] = original.first[p];
+                summary->last[u] = original.last[p];
+            }
+        }
+    }
+
+    sanisizer::resize(output, ninputs);
+    if (mapping) {
+        sanisizer::resize(*mapping, ninputs);
+    }
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        const auto& curcodes = combined_codes[f];
+        const auto& curlevels = levels[f];
+        auto& curout = output[f];
+        curout.reserve(nuniq);
+        for (auto p : permutation) {
+            curout.push_back(curlevels[curcodes[p]]);
+        }
+        if (mapping) {
+            auto& curmapping = (*mapping)[f];
+            curmapping.clear();
+            curmapping.reserve(nuniq);
+            for (auto p : permutation) {
+                curmapping.push_back(curcodes[p]);
+            }
+        }
+    }
+
+    if (nested) {
+        nested->clear();
+        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+            if (parents[f] != ninputs) {
+                nested->emplace_back(f, parents[f]);
+            }
+        }
+    }
+    return true;
+}
+
+template<typename Input_, typename Code_>
+bool combine_to_factor_nested(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const int num_threads, FactorSummary* const summary, std::vector<std::vector<Input_> >& output, std::vector<std::pair<std::size_t, std::size_t> >* const nested) {
+    const auto ninputs = inputs.size();
+    auto levels = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    auto level_codes = sanisizer::create<std::vector<std::vector<Code_> > >(ninputs);
+    CreateFactorOptions fopt;
+    fopt.num_threads = num_threads;
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        sanisizer::resize(level_codes[f], n);
+        levels[f] = create_factor(n, inputs[f], level_codes[f].data(), fopt);
+    }
+    return combine_to_factor_nested(n, levels, level_codes, codes, num_threads, summary, output, nested, static_cast<std::vector<std::vector<Code_> >*>(NULL));
+}
+
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const CombineToFactorOptions& options, FactorSummary* const summary, std::vector<std::pair<std::size_t, std::size_t> >* const nested = NULL) {
+    const auto ninputs = inputs.size();
+    if (nested) {
+        nested->clear();
+    }
+
+    // Handling the special cases.
+    if (ninputs == 0) {
+        std::fill_n(codes, n, 0);
+        if (summary) {
+            resize_summary(*summary, n > 0);
+            if (n > 0) {
+                set_summary_from_run(*summary, 0, 0, n);
+            }
+        }
+        return std::vector<std::vector<Input_> >();
+    }
+
+    const bool use_sort = (options.strategy == CombineToFactorStrategy::SORT);
+    const int num_threads = std::max(1, options.num_threads);
+
+    if constexpr(is_hashable<Input_>()) {
+        if (ninputs == 1) {
+            CreateFactorOptions fopt;
+            if (use_sort) {
+                fopt.strategy = CreateFactorStrategy::SORT;
+            }
+            fopt.num_threads = num_threads;
+            auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+            output[0] = create_factor(n, inputs.front(), codes, fopt, summary);
+            return output;
+        }
+
+        if (options.detect_nested) {
+            std::vector<std::vector<Input_> > output;
+            if (combine_to_factor_nested(n, inputs, codes, num_threads, summary, output, nested)) {
+                return output;
+            }
+        }
+
+        if constexpr(is_dense_candidate<Input_>()) {
+            auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+            if (combine_to_factor_dense(n, inputs, codes, output, num_threads, summary)) {
+                return output;
+            }
+        }
+    }
+
+    if (use_sort) {
+        // Using a smaller index type if possible, to reduce memory usage and traffic.
+        if (static_cast<std::uintmax_t>(n) <= static_cast<std::uintmax_t>(std::numeric_limits<std::uint32_t>::max())) {
+            return combine_to_factor_sort<std::uint32_t>(n, inputs, codes, summary);
+        } else {
+            return combine_to_factor_sort<std::size_t>(n, inputs, codes, summary);
+        }
+    }
+
+    if constexpr(is_hashable<Input_>()) {
+        if (options.strategy == CombineToFactorStrategy::HASH) {
+            return combine_to_factor_hash(n, inputs, codes, num_threads, summary);
+        }
+
+        MixedRadixKeys store;
+        std::vector<std::vector<Input_> > levels;
+        if (fold_mixed_radix_keys(n, inputs, num_threads, store, levels)) {
+            CreateFactorOptions fopt;
+            fopt.num_threads = num_threads;
+            const auto unique_keys = create_factor(n, store.keys.data(), codes, fopt, summary);
+            return decode_mixed_radix_levels(unique_keys, store, levels);
+        }
+    }
+
+    return combine_to_factor_map_sorted(n, inputs, codes, summary);
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Combine multiple categorical variables into a single factor.
+ * For integer `Input_`, we first check whether the product of the observed ranges of all variables is no greater than `n`.
+ * If so, the observed combinations are directly identified with a lookup table spanning the Cartesian product of the ranges.
+ * Otherwise, the unique combinations are identified according to `CombineToFactorOptions::strategy`.
+ *
+ * For `CombineToFactorStrategy::MIXED_RADIX`, each variable is first converted into a factor with `create_factor()`.
+ * The codes of all variables are then combined into a single mixed-radix integer key for each observation,
+ * and the factor for the combined variable is obtained by calling `create_factor()` on these keys.
+ * As the levels of each variable are sorted, the sorted keys automatically correspond to lexicographically sorted combinations.
+ * If `Input_` is not hashable, we instead fall back to a slower approach based on a `std::map`.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * Any type may be used here as long as it implements the comparison operators.
+ * This should also be hashable and have an equality operator for best performance.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ * This should be large enough to hold the number of unique combinations.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * On output, the code for observation `i` refers to the factor level defined by indexing into the inner vectors of the output vector,
+ * i.e., for `j := codes[i]`, the factor level is defined by the combination `(output[0][j], output[1][j], ...)`.
+ * @param options Further options.
+ *
+ * @return 
+ * Vector of vectors containing the levels of the combined factor. 
+ * Each inner vector corresponds to a variables in `inputs`, and all inner vectors have the same length.
+ * Corresponding entries of the inner vectors represent a level of the combined factor, in the form of a combination of values from the input variables,
+ * i.e., the first level is defined as `(output[0][0], output[1][0], ...)`, the second level is defined as `(output[0][1], output[1][1], ...)`, and so on.
+ * Each entry in `output[i]` is guaranteed to be a value in `inputs[i]`.
+ * Combinations are guaranteed to be unique and lexicographically sorted (i.e., by the value of the first variable, then the second, and so on).
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const CombineToFactorOptions& options) {
+    return internal::combine_to_factor(n, inputs, codes, options, NULL);
+}
+
+/**
+ * Overload of `combine_to_factor()` that also computes per-level summaries for the combined factor.
+ * This avoids an extra pass over the codes to compute the number of observations and the first/last occurrence of each combination.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * @param options Further options.
+ * @param[out] summary Per-level summaries for the combined factor.
+ * On output, each vector has length equal to the number of unique combinations.
+ *
+ * @return Vector of vectors containing the levels of the combined factor, see `combine_to_factor()` for details.
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const CombineToFactorOptions& options, FactorSummary& summary) {
+    return internal::combine_to_factor(n, inputs, codes, options, &summary);
+}
+
+/**
+ * Overload of `combine_to_factor()` that reports the nested variables that were dropped before combining.
+ * This is only relevant if `CombineToFactorOptions::detect_nested = true`.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * @param options Further options.
+ * @param[out] nested On output, each entry contains the index of a dropped variable in `inputs` and the index of the retained variable in which it is nested.
+ * Entries are sorted by the index of the dropped variable.
+ * This is empty if nesting was not checked, e.g., if `CombineToFactorOptions::detect_nested = false`.
+ *
+ * @return Vector of vectors containing the levels of the combined factor, see `combine_to_factor()` for details.
+ * This always contains the levels of all variables, including those that were dropped before combining.
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const CombineToFactorOptions& options, std::vector<std::pair<std::size_t, std::size_t> >& nested) {
+    return internal::combine_to_factor(n, inputs, codes, options, NULL, &nested);
+}
+
+/**
+ * Overload of `combine_to_factor()` with default options.
+ *
  * @tparam Input_ Type of the categorical variables to be combined.
- * Any type may be used here as long as it implements the comparison operators.
  * @tparam Code_ Integer type of the codes of the combined factor.
- * This should be large enough to hold the number of unique combinations.
  *
  * @param n Number of observations (i.e., cells).
  * @param[in] inputs Vector of pointers to arrays of length `n`, each containing a different categorical variable.
  * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
- * On output, the code for observation `i` refers to the factor level defined by indexing into the inner vectors of the output vector,
- * i.e., for `j := codes[i]`, the factor level is defined by the combination `(output[0][j], output[1][j], ...)`.
  *
- * @return 
- * Vector of vectors containing the levels of the combined factor. 
- * Each inner vector corresponds to a variables in `inputs`, and all inner vectors have the same length.
- * Corresponding entries of the inner vectors represent a level of the combined factor, in the form of a combination of values from the input variables,
- * i.e., the first level is defined as `(output[0][0], output[1][0], ...)`, the second level is defined as `(output[0][1], output[1][1], ...)`, and so on.
- * Each entry in `output[i]` is guaranteed to be a value in `inputs[i]`.
- * Combinations are guaranteed to be unique and lexicographically sorted (i.e., by the value of the first variable, then the second, and so on).
+ * @return Vector of vectors containing the levels of the combined factor, see `combine_to_factor()` for details.
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes) {
+    return combine_to_factor(n, inputs, codes, CombineToFactorOptions());
+}
+
+/**
+ * @brief Marginal factors for each variable in `combine_to_factor()`.
+ *
+ * @tparam Input_ Type of the categorical variables.
+ * @tparam Code_ Integer type of the codes.
+ */
+template<typename Input_, typename Code_>
+struct CombineToFactorMarginals {
+    /**
+     * Sorted and unique levels of each variable, i.e., the same as the output of `create_factor()` for that variable.
+     */
+    std::vector<std::vector<Input_> > levels;
+
+    /**
+     * Codes for each variable, i.e., the same as the codes from `create_factor()` for that variable.
+     * Each inner vector has length equal to the number of observations, where each entry is an index into the corresponding vector of `levels`.
+     */
+    std::vector<std::vector<Code_> > codes;
+
+    /**
+     * Mapping from the codes of the combined factor to the codes of each variable.
+     * Each inner vector has length equal to the number of unique combinations.
+     * For combined code `c`, the value of variable `f` in the corresponding combination is `levels[f][mapping[f][c]]`.
+     */
+    std::vector<std::vector<Code_> > mapping;
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Input_, typename Code_>
+void fill_marginal_codes(const std::size_t n, const Code_* const codes, const int num_threads, CombineToFactorMarginals<Input_, Code_>& marginals) {
+    const auto ninputs = marginals.mapping.size();
+    sanisizer::resize(marginals.codes, ninputs);
+    for (auto& curcodes : marginals.codes) {
+        sanisizer::resize(curcodes, n);
+    }
+    subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+            const auto& curmapping = marginals.mapping[f];
+            auto& curcodes = marginals.codes[f];
+            for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+                curcodes[i] = curmapping[codes[i]];
+            }
+        }
+    });
+}
+
+// Factorizing the combined levels of each variable, and then mapping each observation's combined code to its marginal code.
+// This is cheaper than factorizing each variable from scratch as there cannot be more unique combinations than observations.
+template<typename Input_, typename Code_>
+void fill_marginals_from_combined(const std::size_t n, const std::vector<std::vector<Input_> >& combined, const Code_* const codes, const int num_threads, CombineToFactorMarginals<Input_, Code_>& marginals) {
+    const auto ninputs = combined.size();
+    sanisizer::resize(marginals.levels, ninputs);
+    sanisizer::resize(marginals.mapping, ninputs);
+
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        const auto& curcombined = combined[f];
+        const auto ncombos = curcombined.size();
+        auto& curmapping = marginals.mapping[f];
+        sanisizer::resize(curmapping, ncombos);
+        auto& curlevels = marginals.levels[f];
+
+        if constexpr(is_hashable<Input_>()) {
+            CreateFactorOptions fopt;
+            fopt.num_threads = num_threads;
+            fopt.detect_runs = (f == 0); // combinations are sorted by the first variable.
+            curlevels = create_factor(ncombos, curcombined.data(), curmapping.data(), fopt);
+        } else {
+            curlevels = curcombined;
+            std::sort(curlevels.begin(), curlevels.end());
+            curlevels.erase(std::unique(curlevels.begin(), curlevels.end()), curlevels.end());
+            for (I<decltype(ncombos)> c = 0; c < ncombos; ++c) {
+                curmapping[c] = std::lower_bound(curlevels.begin(), curlevels.end(), curcombined[c]) - curlevels.begin();
+            }
+        }
+    }
+
+    fill_marginal_codes(n, codes, num_threads, marginals);
+}
+
+// Filling the mapping from the combined codes and the marginal codes, e.g., if the combinations were not constructed from the marginal codes.
+template<typename Input_, typename Code_>
+void fill_marginal_mapping(const std::size_t n, const Code_* const codes, const std::size_t ncombos, const int num_threads, CombineToFactorMarginals<Input_, Code_>& marginals) {
+    const auto ninputs = marginals.codes.size();
+    sanisizer::resize(marginals.mapping, ninputs);
+    subpar::parallelize_range(num_threads, ninputs, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        for (I<decltype(start)> f = start, end = start + length; f < end; ++f) {
+            const auto& curcodes = marginals.codes[f];
+            auto& curmapping = marginals.mapping[f];
+            sanisizer::resize(curmapping, ncombos);
+            for (I<decltype(n)> i = 0; i < n; ++i) {
+                curmapping[codes[i]] = curcodes[i];
+            }
+        }
+    });
+}
+
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const CombineToFactorOptions& options, CombineToFactorMarginals<Input_, Code_>& marginals) {
+    const auto ninputs = inputs.size();
+    const int num_threads = std::max(1, options.num_threads);
+
+    if constexpr(is_hashable<Input_>()) {
+        // Both the mixed-radix keys and the detection of nested variables need the factor for each variable, so we hold onto them as the marginals.
+        if (ninputs > 1 && (options.strategy == CombineToFactorStrategy::MIXED_RADIX || options.detect_nested)) {
+            if constexpr(is_dense_candidate<Input_>()) {
+                if (!options.detect_nested) {
+                    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+                    if (combine_to_factor_dense(n, inputs, codes, output, num_threads, NULL)) {
+                        fill_marginals_from_combined(n, output, codes, num_threads, marginals);
+                        return output;
+                    }
+                }
+            }
+
+            sanisizer::resize(marginals.levels, ninputs);
+            sanisizer::resize(marginals.codes, ninputs);
+            CreateFactorOptions fopt;
+            fopt.num_threads = num_threads;
+            for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+                auto& curcodes = marginals.codes[f];
+                sanisizer::resize(curcodes, n);
+                marginals.levels[f] = create_factor(n, inputs[f], curcodes.data(), fopt);
+            }
+
+            std::vector<std::vector<Input_> > output;
+            if (options.detect_nested) {
+                if (combine_to_factor_nested(n, marginals.levels, marginals.codes, codes, num_threads, NULL, output, NULL, &(marginals.mapping))) {
+                    return output;
+                }
+            } else {
+                MixedRadixKeys store;
+                auto all = sanisizer::create<std::vector<std::size_t> >(ninputs);
+                std::iota(all.begin(), all.end(), static_cast<std::size_t>(0));
+                if (fold_mixed_radix_codes(n, marginals.levels, marginals.codes, all, num_threads, store)) {
+                    const auto unique_keys = create_factor(n, store.keys.data(), codes, fopt);
+                    const auto level_codes = decode_mixed_radix_keys(unique_keys, store);
+                    sanisizer::resize(output, ninputs);
+                    sanisizer::resize(marginals.mapping, ninputs);
+                    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+                        const auto& curcodes = level_codes[f];
+                        const auto& curlevels = marginals.levels[f];
+                        marginals.mapping[f].assign(curcodes.begin(), curcodes.end());
+                        auto& curout = output[f];
+                        curout.reserve(curcodes.size());
+                        for (auto c : curcodes) {
+                            curout.push_back(curlevels[c]);
+                        }
+                    }
+                    return output;
+                }
+            }
+
+            // If the keys overflow, we fall back to the same approach as the other combine_to_factor() overload, re-using the marginal codes that we already have.
+            if (options.detect_nested) {
+                auto fallback = options;
+                fallback.detect_nested = false;
+                output = combine_to_factor(n, inputs, codes, fallback, NULL);
+            } else {
+                // We've already tried the dense path and the keys will overflow again, so we go straight to the std::map.
+                output = combine_to_factor_map_sorted(n, inputs, codes, NULL);
+            }
+            fill_marginal_mapping(n, codes, output.front().size(), num_threads, marginals);
+            return output;
+        }
+    }
+
+    auto output = combine_to_factor(n, inputs, codes, options, NULL);
+    fill_marginals_from_combined(n, output, codes, num_threads, marginals);
+    return output;
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Overload of `combine_to_factor()` that also reports the marginal factor for each variable.
+ * This is equivalent to calling `create_factor()` on each variable, but re-uses the work that is already performed to combine the variables.
+ * For `CombineToFactorStrategy::MIXED_RADIX`, the factor for each variable is directly obtained from the construction of the mixed-radix keys.
+ * Similarly, if `CombineToFactorOptions::detect_nested = true`, the factors that are used to identify nested variables are reported as the marginals.
+ * Otherwise, the marginal factors are derived from the unique combinations, which are no more numerous than the observations.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * @tparam Code_ Integer type of the codes of the combined and marginal factors.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * @param options Further options.
+ * @param[out] marginals Marginal factors for each variable.
+ * On output, each vector has length equal to the number of variables in `inputs`.
+ *
+ * @return Vector of vectors containing the levels of the combined factor, see `combine_to_factor()` for details.
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const CombineToFactorOptions& options, CombineToFactorMarginals<Input_, Code_>& marginals) {
+    return internal::combine_to_factor(n, inputs, codes, options, marginals);
+}
+
+/**
+ * Extend an existing combined factor with one more variable, e.g., to build blocking factors step by step.
+ * The new variable is converted into a factor with `create_factor()`, and the existing code and the new variable's code are combined into an integer key for each observation.
+ * The refined factor is then obtained by calling `create_factor()` on these keys, without revisiting any of the variables used to construct the existing factor.
+ * The output is the same as calling `combine_to_factor()` on all of the previous variables along with `input`.
+ *
+ * @tparam Input_ Type of the categorical variables.
+ * This should be hashable and have an equality operator.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ * This should be large enough to hold the number of unique combinations after adding `input`.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] existing_codes Pointer to an array of length `n` containing the codes of the existing combined factor, e.g., from `combine_to_factor()`.
+ * @param existing_levels Levels of the existing combined factor, e.g., from `combine_to_factor()`.
+ * Combinations should be unique and lexicographically sorted.
+ * @param[in] input Pointer to an array of length `n` containing the new categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the refined factor are to be stored.
+ * This may be the same as `existing_codes`.
+ * @param options Further options.
+ *
+ * @return Vector of vectors containing the levels of the refined factor, see `combine_to_factor()` for details.
+ * This has one more inner vector than `existing_levels`, corresponding to `input`.
+ * Combinations are guaranteed to be unique and lexicographically sorted.
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > extend_combined_factor(const std::size_t n, const Code_* const existing_codes, const std::vector<std::vector<Input_> >& existing_levels, const Input_* const input, Code_* const codes, const CombineToFactorOptions& options) {
+    const int num_threads = std::max(1, options.num_threads);
+    CreateFactorOptions fopt;
+    if (options.strategy == CombineToFactorStrategy::SORT) {
+        fopt.strategy = CreateFactorStrategy::SORT;
+    }
+    fopt.num_threads = num_threads;
+
+    auto keys = sanisizer::create<std::vector<std::uint64_t> >(n);
+    const auto new_levels = create_factor(n, input, keys.data(), fopt);
+    const auto ninputs = existing_levels.size();
+    const std::uint64_t nexisting = (ninputs == 0 ? 1 : existing_levels.front().size());
+    const std::uint64_t nnew = new_levels.size();
+    if (nnew && nexisting > std::numeric_limits<std::uint64_t>::max() / nnew) {
+        throw std::overflow_error("number of combinations cannot be stored in a 64-bit key");
+    }
+
+    // As the existing codes and new levels are both sorted, the order of the keys is the same as the lexicographic order of the combinations.
+    subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+            keys[i] += static_cast<std::uint64_t>(existing_codes[i]) * nnew;
+        }
+    });
+    const auto unique_keys = create_factor(n, keys.data(), codes, fopt);
+
+    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(sanisizer::sum<std::size_t>(ninputs, 1));
+    const auto nuniq = unique_keys.size();
+    for (auto& out : output) {
+        out.reserve(nuniq);
+    }
+    for (auto key : unique_keys) {
+        const auto existing = key / nnew;
+        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+            output[f].push_back(existing_levels[f][existing]);
+        }
+        output[ninputs].push_back(new_levels[key % nnew]);
+    }
+
+    return output;
+}
+
+/**
+ * Overload of `extend_combined_factor()` with default options.
+ *
+ * @tparam Input_ Type of the categorical variables.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] existing_codes Pointer to an array of length `n` containing the codes of the existing combined factor.
+ * @param existing_levels Levels of the existing combined factor.
+ * @param[in] input Pointer to an array of length `n` containing the new categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the refined factor are to be stored.
+ *
+ * @return Vector of vectors containing the levels of the refined factor, see `extend_combined_factor()` for details.
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > extend_combined_factor(const std::size_t n, const Code_* const existing_codes, const std::vector<std::vector<Input_> >& existing_levels, const Input_* const input, Code_* const codes) {
+    return extend_combined_factor(n, existing_codes, existing_levels, input, codes, CombineToFactorOptions());
+}
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Code_, typename ... Input_, std::size_t ... Index_>
+std::tuple<std::vector<Input_>...> combine_to_factor_tuple(const std::size_t n, const std::tuple<const Input_*...>& inputs, Code_* const codes, const CombineToFactorOptions& options, std::index_sequence<Index_...>) {
+    if constexpr(sizeof...(Input_) == 0) {
+        std::fill_n(codes, n, 0);
+        return std::tuple<>();
+    } else {
+        const int num_threads = std::max(1, options.num_threads);
+        CreateFactorOptions fopt;
+        if (options.strategy == CombineToFactorStrategy::SORT) {
+            fopt.strategy = CreateFactorStrategy::SORT;
+        }
+        fopt.num_threads = num_threads;
+
+        std::tuple<std::vector<Input_>...> levels;
+        MixedRadixKeys store;
+        initialize_mixed_radix_keys(n, store);
+
+        // Each variable is factorized by its own instantiation of create_factor(), unrolled at compile time.
+        const auto fold = [&](auto& curlevels, const auto* const curinput) -> void {
+            curlevels = create_factor(n, curinput, store.buffer.data(), fopt, NULL);
+            if (!fold_mixed_radix_keys(n, curlevels.size(), num_threads, store)) {
+                // There's no std::map fallback for heterogeneous types, so we just report the overflow.
+                throw std::overflow_error("number of combinations cannot be stored in a 64-bit key");
+            }
+        };
+        (fold(std::get<Index_>(levels), std::get<Index_>(inputs)), ...);
+
+        const auto unique_keys = create_factor(n, store.keys.data(), codes, fopt, NULL);
+        const auto level_codes = decode_mixed_radix_keys(unique_keys, store);
+
+        std::tuple<std::vector<Input_>...> output;
+        const auto extract = [&](auto& curout, const auto& curlevels, const std::vector<std::size_t>& curcodes) -> void {
+            curout.reserve(curcodes.size());
+            for (auto c : curcodes) {
+                curout.push_back(curlevels[c]);
+            }
+        };
+        (extract(std::get<Index_>(output), std::get<Index_>(levels), level_codes[Index_]), ...);
+
+        return output;
+    }
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Overload of `combine_to_factor()` for variables of different types, e.g., string sample names with integer cluster identities.
+ * This avoids the need to convert all variables to a common type before combining them.
+ * Each variable is converted into a factor with `create_factor()` and the per-variable codes are combined into mixed-radix keys,
+ * see `CombineToFactorStrategy::MIXED_RADIX` for details.
+ * An error is raised if the mixed-radix keys cannot be stored in 64 bits even after compaction (i.e., with more than \f$2^{32}\f$ observations),
+ * as there is no fallback for variables of different types.
+ *
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ * This should be large enough to hold the number of unique combinations.
+ * @tparam Input_ Types of the categorical variables to be combined.
+ * Each type should be hashable, have an equality operator and implement the comparison operators.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Tuple of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * On output, the code for observation `i` refers to the factor level defined by indexing into the vectors of the output tuple,
+ * i.e., for `j := codes[i]`, the factor level is defined by the combination `(std::get<0>(output)[j], std::get<1>(output)[j], ...)`.
+ * @param options Further options.
+ * The mixed-radix keys are always used, so `CombineToFactorOptions::strategy` only determines whether the per-variable factors and keys are identified by hashing or sorting.
+ * `CombineToFactorOptions::detect_nested` is ignored.
+ *
+ * @return Tuple of vectors containing the levels of the combined factor.
+ * This has the same structure as the output of `combine_to_factor()`, except that each variable's vector has its own type.
+ * Combinations are guaranteed to be unique and lexicographically sorted.
+ */
+template<typename Code_, typename ... Input_>
+std::tuple<std::vector<Input_>...> combine_to_factor(const std::size_t n, const std::tuple<const Input_*...>& inputs, Code_* const codes, const CombineToFactorOptions& options) {
+    return internal::combine_to_factor_tuple(n, inputs, codes, options, std::index_sequence_for<Input_...>());
+}
+
+/**
+ * Overload of `combine_to_factor()` for variables of different types, using the default options.
+ *
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ * @tparam Input_ Types of the categorical variables to be combined.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Tuple of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ *
+ * @return Tuple of vectors containing the levels of the combined factor.
+ */
+template<typename Code_, typename ... Input_>
+std::tuple<std::vector<Input_>...> combine_to_factor(const std::size_t n, const std::tuple<const Input_*...>& inputs, Code_* const codes) {
+    return combine_to_factor(n, inputs, codes, CombineToFactorOptions());
+}
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Input_>
+constexpr bool is_packable() {
+    return std::is_integral<Input_>::value && !std::is_same<Input_, bool>::value && sizeof(Input_) <= 4;
+}
+
+// Packs the order-preserving keys of the variables in [first, last) into a single 64-bit word for each observation.
+// The first variable occupies the most significant bits, so the order of the packed keys is the same as the lexicographic order of the combinations.
+template<typename Input_, std::size_t N_>
+void pack_combinations(const std::size_t n, const std::array<const Input_*, N_>& inputs, const std::size_t first, const std::size_t last, std::uint64_t* const packed, const int num_threads) {
+    constexpr int bits = std::numeric_limits<typename RadixKey<Input_>::Type>::digits;
+    subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        std::fill_n(packed + start, length, 0);
+        for (auto f = first; f < last; ++f) {
+            const auto curf = inputs[f];
+            for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+                packed[i] = (packed[i] << bits) | to_radix_key(curf[i]);
+            }
+        }
+    });
+}
+
+template<typename Input_, std::size_t N_>
+void unpack_combination(std::uint64_t packed, const std::size_t first, const std::size_t last, const std::size_t u, std::array<std::vector<Input_>, N_>& levels) {
+    typedef typename RadixKey<Input_>::Type Key;
+    constexpr int bits = std::numeric_limits<Key>::digits;
+    for (auto f = last; f > first; --f) {
+        levels[f - 1][u] = from_radix_key<Input_>(static_cast<Key>(packed));
+        packed >>= bits;
+    }
+}
+
+template<typename Input_, std::size_t N_, typename Code_>
+std::array<std::vector<Input_>, N_> combine_to_factor_array(const std::size_t n, const std::array<const Input_*, N_>& inputs, Code_* const codes, const CombineToFactorOptions& options) {
+    const std::vector<const Input_*> inputs_vec(inputs.begin(), inputs.end());
+    const auto convert = [&](std::vector<std::vector<Input_> > levels) -> std::array<std::vector<Input_>, N_> {
+        std::array<std::vector<Input_>, N_> output;
+        for (std::size_t f = 0; f < N_; ++f) {
+            output[f].swap(levels[f]);
+        }
+        return output;
+    };
+
+    if (options.detect_nested) {
+        return convert(combine_to_factor(n, inputs_vec, codes, options, NULL));
+    }
+
+    if constexpr(is_packable<Input_>() && N_ >= 2) {
+        const int num_threads = std::max(1, options.num_threads);
+        {
+            std::vector<std::vector<Input_> > levels(N_);
+            if (combine_to_factor_dense(n, inputs_vec, codes, levels, num_threads, NULL)) {
+                return convert(std::move(levels));
+            }
+        }
+
+        constexpr std::size_t per_word = 64 / std::numeric_limits<typename RadixKey<Input_>::Type>::digits;
+        constexpr std::size_t ngroups = (N_ + per_word - 1) / per_word;
+        CreateFactorOptions fopt;
+        if (options.strategy == CombineToFactorStrategy::SORT) {
+            fopt.strategy = CreateFactorStrategy::SORT;
+        }
+        fopt.num_threads = num_threads;
+
+        std::array<std::vector<Input_>, N_> output;
+        const auto allocate = [&](const std::size_t nuniq) -> void {
+            for (auto& out : output) {
+                sanisizer::resize(out, nuniq);
+            }
+        };
+
+        auto packed = sanisizer::create<std::vector<std::uint64_t> >(n);
+        if constexpr(ngroups == 1) {
+            // All variables fit into a single word, so we only need to factorize the packed keys.
+            pack_combinations(n, inputs, 0, N_, packed.data(), num_threads);
+            const auto unique = create_factor(n, packed.data(), codes, fopt, NULL);
+            const auto nuniq = unique.size();
+            allocate(nuniq);
+            for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+                unpack_combination(unique[u], 0, N_, u, output);
+            }
+            return output;
+
+        } else {
+            // Otherwise, each word is treated as a variable in the mixed-radix keys.
+            MixedRadixKeys store;
+            initialize_mixed_radix_keys(n, store);
+            std::array<std::vector<std::uint64_t>, ngroups> group_levels;
+            bool okay = true;
+            for (std::size_t g = 0; g < ngroups && okay; ++g) {
+                pack_combinations(n, inputs, g * per_word, std::min(N_, (g + 1) * per_word), packed.data(), num_threads);
+                group_levels[g] = create_factor(n, packed.data(), store.buffer.data(), fopt, NULL);
+                okay = fold_mixed_radix_keys(n, group_levels[g].size(), num_threads, store);
+            }
+
+            if (okay) {
+                CreateFactorOptions kopt;
+                kopt.num_threads = num_threads;
+                const auto unique_keys = create_factor(n, store.keys.data(), codes, kopt, NULL);
+                const auto group_codes = decode_mixed_radix_keys(unique_keys, store);
+                const auto nuniq = unique_keys.size();
+                allocate(nuniq);
+                for (std::size_t g = 0; g < ngroups; ++g) {
+                    const auto& curcodes = group_codes[g];
+                    const auto& curlevels = group_levels[g];
+                    for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+                        unpack_combination(curlevels[curcodes[u]], g * per_word, std::min(N_, (g + 1) * per_word), u, output);
+                    }
+                }
+                return output;
+            }
+        }
+    }
+
+    return convert(combine_to_factor(n, inputs_vec, codes, options, NULL));
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Overload of `combine_to_factor()` for a compile-time number of variables.
+ * For integer types of 32 bits or narrower, the order-preserving bit patterns of multiple variables are packed into a single 64-bit word for each observation,
+ * e.g., two 32-bit variables or three 16-bit variables.
+ * If all variables fit into one word, the combined factor is obtained by calling `create_factor()` on the packed words;
+ * otherwise, each word is treated as a separate variable in the mixed-radix keys, see `CombineToFactorStrategy::MIXED_RADIX`.
+ * For other types, this is equivalent to calling `combine_to_factor()` on a vector of pointers.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * @tparam N_ Number of variables.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Array of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * @param options Further options.
+ * For packed integers, `CombineToFactorStrategy::SORT` will radix sort the packed words, while the other strategies will hash them.
+ *
+ * @return Array of vectors containing the levels of the combined factor, see `combine_to_factor()` for details.
+ */
+template<typename Input_, std::size_t N_, typename Code_>
+std::array<std::vector<Input_>, N_> combine_to_factor(const std::size_t n, const std::array<const Input_*, N_>& inputs, Code_* const codes, const CombineToFactorOptions& options) {
+    return internal::combine_to_factor_array(n, inputs, codes, options);
+}
+
+/**
+ * Overload of `combine_to_factor()` for a compile-time number of variables with default options.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * @tparam N_ Number of variables.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Array of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ *
+ * @return Array of vectors containing the levels of the combined factor, see `combine_to_factor()` for details.
+ */
+template<typename Input_, std::size_t N_, typename Code_>
+std::array<std::vector<Input_>, N_> combine_to_factor(const std::size_t n, const std::array<const Input_*, N_>& inputs, Code_* const codes) {
+    return combine_to_factor(n, inputs, codes, CombineToFactorOptions());
+}
+
+/**
+ * @cond
+ */
+namespace internal {
+
+// Each thread assigns block-specific codes in order of first appearance within its block of observations.
+// The representatives of all blocks are then gathered in block order and deduplicated with another pass of the same hash table,
+// which yields codes in order of first appearance across all observations, regardless of the number of threads.
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor_hash_unsorted(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const int num_threads) {
+    const auto ninputs = inputs.size();
+    std::vector<std::vector<std::size_t> > block_representatives(num_threads);
+    std::vector<std::pair<std::size_t, std::size_t> > block_ranges(num_threads);
+    subpar::parallelize_range(num_threads, n, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+        block_ranges[t] = std::make_pair(start, length);
+        block_representatives[t] = hash_combination_block(inputs, codes, start, length, NULL);
+    });
+
+    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    if (num_threads == 1) {
+        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+            auto& curout = output[f];
+            curout.reserve(block_representatives[0].size());
+            for (auto r : block_representatives[0]) {
+                curout.push_back(inputs[f][r]);
+            }
+        }
+        return output;
+    }
+
+    std::size_t ngathered = 0;
+    for (const auto& reps : block_representatives) {
+        ngathered = sanisizer::sum<std::size_t>(ngathered, reps.size());
+    }
+    auto gathered = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    std::vector<const Input_*> gathered_ptrs;
+    gathered_ptrs.reserve(ninputs);
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        auto& curgathered = gathered[f];
+        curgathered.reserve(ngathered);
+        for (const auto& reps : block_representatives) {
+            for (auto r : reps) {
+                curgathered.push_back(inputs[f][r]);
+            }
+        }
+        gathered_ptrs.push_back(curgathered.data());
+    }
+
+    auto gathered_codes = sanisizer::create<std::vector<Code_> >(ngathered);
+    const auto unique = hash_combination_block(gathered_ptrs, gathered_codes.data(), 0, ngathered, NULL);
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        auto& curout = output[f];
+        curout.reserve(unique.size());
+        for (auto u : unique) {
+            curout.push_back(gathered[f][u]);
+        }
+    }
+
+    // The first block's combinations are always the first to appear, so its codes are already correct.
+    std::vector<std::vector<Code_> > block_remapping(num_threads);
+    std::size_t offset = block_representatives[0].size();
+    for (int t = 1; t < num_threads; ++t) {
+        const auto nlocal = block_representatives[t].size();
+        block_remapping[t].insert(block_remapping[t].end(), gathered_codes.begin() + offset, gathered_codes.begin() + offset + nlocal);
+        offset += nlocal;
+    }
+    remap_blocks(codes, block_ranges, block_remapping, 1, num_threads);
+    return output;
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * This function is a variation of `combine_to_factor()` where the combined levels are ordered by their first appearance.
+ * This skips the sorting of the unique combinations and the remapping of codes to the sorted order, which is useful when the caller only needs consistent codes.
+ * If sorted levels are required later, callers can use `sort_combined_levels()` to obtain the sorted levels and a remapping for the codes.
+ *
+ * For hashable `Input_`, the unique combinations are identified with a hash table in the same manner as `CombineToFactorStrategy::HASH`.
+ * Otherwise, we fall back to a slower approach based on a `std::map`.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * Any type may be used here as long as it implements the comparison operators.
+ * This should also be hashable and have an equality operator for best performance.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * See the argument of the same name in `combine_to_factor()` for more details.
+ * @param options Further options.
+ * `CombineToFactorOptions::strategy` and `CombineToFactorOptions::detect_nested` are ignored.
+ *
+ * @return Vector of vectors containing the levels of the combined factor, see `combine_to_factor()` for details.
+ * Combinations are unique and ordered by their first appearance across observations.
  */
 template<typename Input_, typename Code_>
-std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes) {
+std::vector<std::vector<Input_> > combine_to_factor_unsorted(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes, const CombineToFactorOptions& options) {
     const auto ninputs = inputs.size();
     auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    const int num_threads = std::max(1, options.num_threads);
 
     // Handling the special cases.
     if (ninputs == 0) {
         std::fill_n(codes, n, 0);
         return output;
     }
-    if (ninputs == 1) {
-        output[0] = create_factor(n, inputs.front(), codes);
-        return output;
+
+    if constexpr(internal::is_hashable<Input_>()) {
+        if (ninputs == 1) {
+            CreateFactorOptions fopt;
+            fopt.num_threads = num_threads;
+            output[0] = create_factor_unsorted(n, inputs.front(), codes, fopt);
+            return output;
+        }
+        return internal::combine_to_factor_hash_unsorted(n, inputs, codes, num_threads);
     }
 
-    // Creating a hashmap on the combinations of each factor.
-    struct Combination {
-        Combination(const std::size_t i) : index(i) {}
-        std::size_t index;
-    };
+    const auto unique = internal::combine_to_factor_map(n, inputs, codes);
+    const auto nuniq = unique.size();
+    for (auto& ofac : output) {
+        sanisizer::resize(ofac, nuniq);
+    }
+    for (const auto& u : unique) {
+        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+            output[f][u.second] = inputs[f][u.first];
+        }
+    }
 
-    auto unique = [&]{ // scoping this in an IIFE to release map memory sooner.
-        // Using a map with a custom comparator that uses the index
-        // of first occurrence of each factor as the key. Currently using a map
-        // to (i) avoid issues with collisions of combined hashes and (ii)
-        // avoid having to write more code for sorting a vector of arrays.
-        auto cmp = [&](const Combination& left, const Combination& right) -> bool {
-            for (auto curf : inputs) {
-                if (curf[left.index] < curf[right.index]) {
-                    return true;
-                } else if (curf[left.index] > curf[right.index]) {
-                    return false;
-                }
-            }
-            return false;
-        };
-        std::map<Combination, Code_, I<decltype(cmp)> > mapping(std::move(cmp));
+    return output;
+}
 
-        const auto eq = [&](const Combination& left, const Combination& right) -> bool {
-            for (auto curf : inputs) {
-                if (curf[left.index] != curf[right.index]) {
-                    return false;
-                }
-            }
-            return true;
-        };
+/**
+ * Overload of `combine_to_factor_unsorted()` with default options.
+ *
+ * @tparam Input_ Type of the categorical variables to be combined.
+ * @tparam Code_ Integer type of the codes of the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pointers to arrays of length `n`, each containing a different categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ *
+ * @return Vector of vectors containing the levels of the combined factor, see `combine_to_factor_unsorted()` for details.
+ */
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor_unsorted(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes) {
+    return combine_to_factor_unsorted(n, inputs, codes, CombineToFactorOptions());
+}
 
-        for (I<decltype(n)> i = 0; i < n; ++i) {
-            Combination current(i);
-            const auto mIt = mapping.find(current);
-            if (mIt == mapping.end() || !eq(mIt->first, current)) {
-                Code_ alt = mapping.size();
-                mapping.insert(mIt, std::make_pair(current, alt));
-                codes[i] = alt;
-            } else {
-                codes[i] = mIt->second;
+/**
+ * Sort the levels of a combined factor, e.g., from `combine_to_factor_unsorted()`.
+ *
+ * @tparam Code_ Integer type for the combined factor codes.
+ * @tparam Input_ Type of the categorical variables.
+ *
+ * @param[in,out] levels Vector of vectors containing the unique combined levels, see the output of `combine_to_factor()` for details.
+ * On output, the combinations are sorted in lexicographic order.
+ *
+ * @return Vector of length equal to the number of combined levels, mapping each original code to its code in the sorted levels.
+ * Callers can then apply this remapping to existing codes, i.e., `codes[i] = output[codes[i]]`.
+ */
+template<typename Code_, typename Input_>
+std::vector<Code_> sort_combined_levels(std::vector<std::vector<Input_> >& levels) {
+    if (levels.empty()) {
+        return std::vector<Code_>(1); // there is always one combination, even with no variables.
+    }
+
+    const auto nuniq = levels.front().size();
+    std::vector<std::size_t> order(nuniq);
+    std::iota(order.begin(), order.end(), static_cast<std::size_t>(0));
+    std::sort(order.begin(), order.end(), [&](const std::size_t left, const std::size_t right) -> bool {
+        for (const auto& curf : levels) {
+            if (curf[left] < curf[right]) {
+                return true;
+            } else if (curf[right] < curf[left]) {
+                return false;
             }
         }
+        return false;
+    });
 
-        return std::vector<std::pair<Combination, Code_> >(mapping.begin(), mapping.end());
-    }();
-
-    // Remapping to a sorted set.
-    const auto nuniq = unique.size();
-    for (auto& ofac : output) {
-        ofac.reserve(nuniq);
-    }
     auto remapping = sanisizer::create<std::vector<Code_> >(nuniq);
     for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
-        const auto ix = unique[u].first.index;
-        for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
-            output[f].push_back(inputs[f][ix]);
+        remapping[order[u]] = u;
+    }
+
+    std::vector<Input_> buffer(nuniq);
+    for (auto& curf : levels) {
+        for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+            buffer[u] = std::move(curf[order[u]]);
         }
-        remapping[unique[u].second] = u;
+        curf.swap(buffer);
     }
 
-    // Mapping each cell to its sorted combination.
-    for (I<decltype(n)> i = 0; i < n; ++i) {
-        codes[i] = remapping[codes[i]];
+    return remapping;
+}
+
+/**
+ * @brief Options for `combine_to_factor_unused()`.
+ */
+struct CombineToFactorUnusedOptions {
+    /**
+     * Number of threads to use.
+     * The output is the same regardless of the number of threads.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Code_, typename Input_, typename Number_>
+CartesianLevels<Code_> define_unused_levels(const std::vector<std::pair<const Input_*, Number_> >& inputs) {
+    const auto ninputs = inputs.size();
+    auto counts = sanisizer::create<std::vector<Number_> >(ninputs);
+    for (I<decltype(ninputs)> f = 0; f < ninputs; ++f) {
+        counts[f] = inputs[f].second;
     }
+    return CartesianLevels<Code_>(counts);
+}
+
+// Evaluating the mixed-radix expression for a tile of observations at a time, so that 'codes' stays in cache across variables.
+// Products are safe as they are obviously less than the number of combinations for 'input[f][i] < inputs[f].second'.
+// Additions are also safe as the sum will be less than the number of combinations, though this is less obvious.
+// 'process' is called on each tile after its codes are computed, e.g., to do further work while the codes are still in cache.
+// If 'codes' is NULL, each thread computes its codes in its own tile-sized buffer, e.g., if the codes are only needed in 'process'.
+template<typename Code_, typename Input_, typename Number_, class Process_>
+void fill_unused_codes(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, const std::vector<Code_>& strides, Code_* const codes, const int num_threads, Process_ process) {
+    const auto ninputs = inputs.size();
+    subpar::parallelize_range(num_threads, n, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+        constexpr std::size_t tile_size = 4096;
+        std::vector<Code_> buffer;
+        if (codes == NULL) {
+            buffer.resize(std::min(tile_size, length));
+        }
+
+        for (I<decltype(length)> offset = 0; offset < length; offset += tile_size) {
+            const auto tile_start = start + offset;
+            const auto tile_codes = (codes == NULL ? buffer.data() : codes + tile_start);
+            const auto tile_length = std::min(tile_size, length - offset);
+
+            if (ninputs == 0) {
+                std::fill_n(tile_codes, tile_length, 0);
+            } else {
+                const auto last = inputs[ninputs - 1].first + tile_start;
+                std::copy_n(last, tile_length, tile_codes);
+                for (I<decltype(ninputs)> f = 0, fend = ninputs - 1; f < fend; ++f) {
+                    const auto ff = inputs[f].first + tile_start;
+                    const Code_ stride = strides[f];
+                    for (I<decltype(tile_length)> i = 0; i < tile_length; ++i) {
+                        tile_codes[i] += sanisizer::product_unsafe<Code_>(stride, ff[i]);
+                    }
+                }
+            }
+
+            process(t, tile_start, tile_codes, tile_length);
+        }
+    });
+}
+
+template<typename Code_, typename Input_, typename Number_>
+CartesianLevels<Code_> compute_unused_codes(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes, const int num_threads) {
+    auto levels = define_unused_levels<Code_>(inputs);
+    fill_unused_codes(n, inputs, levels.strides(), codes, num_threads, [](const int, const std::size_t, const Code_* const, const std::size_t) -> void {});
+    return levels;
+}
 
-    return output;
 }
+/**
+ * @endcond
+ */
 
 /**
  * This function is a variation of `combine_to_factor()` that considers unobserved combinations of variables.
+ * The combined codes are computed in tiles of observations, where all variables are processed for each tile while it is still in cache.
  *
  * @tparam Input_ Factor type.
  * Any type may be used here as long as it is comparable.
@@ -139,77 +1879,446 @@ std::vector<std::vector<Input_> > combine_to_factor(const std::size_t n, const s
  * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
  * On output, each entry determines the corresponding observation's combination of levels by indexing into the inner vectors of the returned object;
  * see the argument of the same name in `combine_to_factor()` for more details.
+ * @param options Further options.
  *
  * @return 
  * Vector of vectors containing all unique and sorted combinations of the input variables.
  * This has the same structure as the output of `combine_to_factor()`,
  * with the only difference being that unobserved combinations are also reported.
+ * If the number of possible combinations is too large for `Code_`, consider using `combine_to_factor_unused_sparse()` instead.
+ */
+template<typename Input_, typename Number_, typename Code_>
+std::vector<std::vector<Input_> > combine_to_factor_unused(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes, const CombineToFactorUnusedOptions& options) {
+    const int num_threads = std::max(1, options.num_threads);
+    const auto levels = internal::compute_unused_codes(n, inputs, codes, num_threads);
+    return levels.template materialize<Input_>(num_threads);
+}
+
+/**
+ * Overload of `combine_to_factor_unused()` with default options.
+ *
+ * @tparam Input_ Factor type.
+ * @tparam Number_ Integer type for the number of unique values in each variable.
+ * @tparam Code_ Integer type for the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pairs, each of which corresponds to a categorical variable.
+ * See the argument of the same name in the other `combine_to_factor_unused()` overload for details.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ *
+ * @return Vector of vectors containing all unique and sorted combinations of the input variables.
  */
 template<typename Input_, typename Number_, typename Code_>
 std::vector<std::vector<Input_> > combine_to_factor_unused(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes) {
-    const auto ninputs = inputs.size();
-    auto output = sanisizer::create<std::vector<std::vector<Input_> > >(ninputs);
+    return combine_to_factor_unused(n, inputs, codes, CombineToFactorUnusedOptions());
+}
 
-    // Handling the special cases.
-    if (ninputs == 0) {
-        std::fill_n(codes, n, 0);
-        return output;
+/**
+ * This function is a variation of `combine_to_factor_unused()` that returns a lazy description of the combined levels.
+ * This avoids materializing a vector of length equal to the number of combinations for each variable,
+ * which saves memory and time when there are many variables.
+ *
+ * @tparam Input_ Factor type.
+ * @tparam Number_ Integer type for the number of unique values in each variable.
+ * @tparam Code_ Integer type for the combined factor.
+ * This should be large enough to hold the number of unique (possibly unused) combinations.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pairs, each of which corresponds to a categorical variable.
+ * See the argument of the same name in `combine_to_factor_unused()` for details.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * These are the same as the codes computed by `combine_to_factor_unused()`.
+ * @param options Further options.
+ *
+ * @return Description of all combinations of the input variables.
+ * For each variable `f` and combined code `c`, `output.level(f, c)` is equal to `combine_to_factor_unused(...)[f][c]`.
+ */
+template<typename Input_, typename Number_, typename Code_>
+CartesianLevels<Code_> combine_to_factor_unused_lazy(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes, const CombineToFactorUnusedOptions& options) {
+    return internal::compute_unused_codes(n, inputs, codes, std::max(1, options.num_threads));
+}
+
+/**
+ * Overload of `combine_to_factor_unused_lazy()` with default options.
+ *
+ * @tparam Input_ Factor type.
+ * @tparam Number_ Integer type for the number of unique values in each variable.
+ * @tparam Code_ Integer type for the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pairs, each of which corresponds to a categorical variable.
+ * See the argument of the same name in `combine_to_factor_unused()` for details.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ *
+ * @return Description of all combinations of the input variables.
+ */
+template<typename Input_, typename Number_, typename Code_>
+CartesianLevels<Code_> combine_to_factor_unused_lazy(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes) {
+    return combine_to_factor_unused_lazy(n, inputs, codes, CombineToFactorUnusedOptions());
+}
+
+/**
+ * This function is a variation of `combine_to_factor_unused()` for situations where the number of possible combinations cannot be stored in `Code_`.
+ * We compute the position of each observation's combination in the full Cartesian product as a 64-bit key,
+ * and then we identify the unique keys that are actually observed.
+ * The combined code for each observation is defined as the rank of its key among the unique keys,
+ * so the codes still respect the ordering of the full product but `Code_` only needs to hold the number of observed combinations.
+ *
+ * @tparam Input_ Factor type.
+ * @tparam Number_ Integer type for the number of unique values in each variable.
+ * @tparam Code_ Integer type for the combined factor.
+ * This should be large enough to hold the number of unique observed combinations.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pairs, each of which corresponds to a categorical variable.
+ * See the argument of the same name in `combine_to_factor_unused()` for details.
+ * An error is raised if the product of the number of unique values across all variables cannot be stored in a 64-bit unsigned integer.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * On output, each entry contains the index of the corresponding observation's combination in `SparseCartesianLevels::keys()`.
+ * @param options Further options.
+ *
+ * @return Description of the observed combinations of the input variables.
+ * For each variable `f` and combined code `c`, `output.level(f, c)` is the level of `f` in the combination corresponding to `c`.
+ * If the product can be stored in `Code_`, the observed combinations are a subset of those reported by `combine_to_factor_unused()` in the same order.
+ */
+template<typename Input_, typename Number_, typename Code_>
+SparseCartesianLevels<Code_> combine_to_factor_unused_sparse(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes, const CombineToFactorUnusedOptions& options) {
+    const int num_threads = std::max(1, options.num_threads);
+    auto keys = sanisizer::create<std::vector<std::uint64_t> >(n);
+    auto space = internal::compute_unused_codes(n, inputs, keys.data(), num_threads);
+
+    CreateFactorOptions copt;
+    copt.num_threads = num_threads;
+    auto unique = create_factor(n, keys.data(), codes, copt);
+    return SparseCartesianLevels<Code_>(std::move(space), std::move(unique));
+}
+
+/**
+ * Overload of `combine_to_factor_unused_sparse()` with default options.
+ *
+ * @tparam Input_ Factor type.
+ * @tparam Number_ Integer type for the number of unique values in each variable.
+ * @tparam Code_ Integer type for the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pairs, each of which corresponds to a categorical variable.
+ * See the argument of the same name in `combine_to_factor_unused()` for details.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ *
+ * @return Description of the observed combinations of the input variables.
+ */
+template<typename Input_, typename Number_, typename Code_>
+SparseCartesianLevels<Code_> combine_to_factor_unused_sparse(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes) {
+    return combine_to_factor_unused_sparse(n, inputs, codes, CombineToFactorUnusedOptions());
+}
+
+/**
+ * @brief Options for `cross_tabulate()`.
+ */
+struct CrossTabulateOptions {
+    /**
+     * Maximum ratio of the number of possible combinations to the number of observations for a dense table.
+     * If the ratio is greater than this value, a sparse table is reported instead.
+     *
+     * This also bounds the memory usage for the dense table, which has no more than `max_dense_ratio * n` counts.
+     * Per-thread tables are only used if their total size is no greater than `n` counts, otherwise a single table is shared by all threads.
+     * Thus, the temporary memory usage is no greater than `max(1, max_dense_ratio) * n` counts in addition to the output table.
+     */
+    double max_dense_ratio = 1;
+
+    /**
+     * Number of threads to use.
+     * The output is the same regardless of the number of threads.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @brief Contingency table for the combinations of categorical variables.
+ *
+ * @tparam Code_ Integer type for the combined codes.
+ */
+template<typename Code_>
+struct CrossTabulation {
+    /**
+     * Description of all possible combinations of the variables.
+     * Each combination is identified by a code in \f$[0, N)\f$ where \f$N\f$ is `levels.size()`.
+     * Only used if `overflow = false`.
+     */
+    CartesianLevels<Code_> levels;
+
+    /**
+     * Whether the table is sparse.
+     */
+    bool sparse = false;
+
+    /**
+     * Sorted codes for the observed combinations.
+     * Only used if `sparse = true` and `overflow = false`.
+     */
+    std::vector<Code_> combinations;
+
+    /**
+     * Whether the number of possible combinations is too large for `Code_`.
+     * If true, `sparse = true` and the observed combinations are described by `observed` instead of `levels` and `combinations`.
+     */
+    bool overflow = false;
+
+    /**
+     * Description of the observed combinations of the variables, as computed by `combine_to_factor_unused_sparse()`.
+     * Only used if `overflow = true`, in which case the combined codes are indices into `observed.keys()`.
+     */
+    SparseCartesianLevels<Code_> observed;
+
+    /**
+     * Number of observations for each combination.
+     * If `sparse = false`, this has length equal to `levels.size()` and contains the count for each combination (i.e., a dense tensor with the last variable changing fastest).
+     * If `sparse = true`, this has the same length as `combinations` (or `observed.keys()`, if `overflow = true`) and contains the count for each corresponding combination.
+     */
+    std::vector<std::size_t> counts;
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+// Each thread counts the keys in its tiles with its own hash table, so the sparse table is built while the keys are still in cache.
+// If 'local' is provided, it is filled with the thread-local index of each key.
+template<typename Key_, typename Code_>
+void count_tile_keys(FlatHashMap<Key_, Code_>& mapping, std::vector<std::size_t>& counts, const Key_* const keys, const std::size_t length, Code_* const local) {
+    for (I<decltype(length)> i = 0; i < length; ++i) {
+        const auto inserted = mapping.insert(keys[i]);
+        if (inserted.second) {
+            counts.push_back(0);
+        }
+        ++counts[inserted.first];
+        if (local) {
+            local[i] = inserted.first;
+        }
     }
-    if (ninputs == 1) {
-        sanisizer::resize(output[0], inputs[0].second);
-        std::iota(output[0].begin(), output[0].end(), static_cast<Code_>(0));
-        std::copy_n(inputs[0].first, n, codes);
-        return output;
+}
+
+// Merging the per-thread tables into sorted keys and their counts.
+// If 'remapping' is provided, it is filled with the position of each thread's local keys in the sorted output.
+// These positions are only meaningful if the number of unique keys fits in Code_, which should be checked by the caller.
+template<typename Key_, typename Code_>
+std::vector<Key_> merge_tile_keys(
+    const std::vector<FlatHashMap<Key_, Code_> >& thread_maps,
+    const std::vector<std::vector<std::size_t> >& thread_counts,
+    std::vector<std::size_t>& counts,
+    std::vector<std::vector<Code_> >* const remapping)
+{
+    const auto nthreads = thread_maps.size();
+    FlatHashMap<Key_, std::size_t> combined(thread_maps.front().size());
+    std::vector<std::size_t> unsorted_counts;
+    if (remapping) {
+        remapping->resize(nthreads);
     }
 
-    // We iterate from back to front, where the first factor is the slowest changing.
-    std::copy_n(inputs[ninputs - 1].first, n, codes); 
-    Code_ ncombos = inputs[ninputs - 1].second;
-    for (I<decltype(ninputs)> f = ninputs - 1; f > 0; --f) {
-        const auto& finfo = inputs[f - 1];
-        const auto next_ncombos = sanisizer::product<Code_>(ncombos, finfo.second);
-        const auto ff = finfo.first;
-        for (I<decltype(n)> i = 0; i < n; ++i) {
-            // Product is safe as it is obviously less than 'next_combos' for 'ff[i] < finfo.second'.
-            // Addition is also safe as it will be less than 'next_combos', though this is less obvious.
-            codes[i] += sanisizer::product_unsafe<Code_>(ncombos, ff[i]);
+    for (I<decltype(nthreads)> t = 0; t < nthreads; ++t) {
+        const auto& curkeys = thread_maps[t].keys();
+        const auto& curcounts = thread_counts[t];
+        const auto nlocal = curkeys.size();
+        if (remapping) {
+            (*remapping)[t].resize(nlocal);
+        }
+        for (I<decltype(nlocal)> l = 0; l < nlocal; ++l) {
+            const auto inserted = combined.insert(curkeys[l]);
+            if (inserted.second) {
+                unsorted_counts.push_back(0);
+            }
+            unsorted_counts[inserted.first] += curcounts[l];
+            if (remapping) {
+                (*remapping)[t][l] = inserted.first;
+            }
         }
-        ncombos = next_ncombos;
     }
 
-    sanisizer::cast<I<decltype(output[0].size())> >(ncombos); // check that we can actually make the output vectors.
-    Code_ outer_repeats = ncombos;
-    Code_ inner_repeats = 1;
-    for (I<decltype(ninputs)> f = ninputs; f > 0; --f) {
-        auto& out = output[f - 1];
-        out.reserve(ncombos);
+    const auto nuniq = combined.size();
+    auto order = sanisizer::create<std::vector<std::size_t> >(nuniq);
+    std::iota(order.begin(), order.end(), static_cast<std::size_t>(0));
+    const auto& unsorted_keys = combined.keys();
+    std::sort(order.begin(), order.end(), [&](const std::size_t left, const std::size_t right) -> bool {
+        return unsorted_keys[left] < unsorted_keys[right];
+    });
 
-        const auto& finfo = inputs[f - 1];
-        const Code_ initial_size = inner_repeats * finfo.second;
-        out.resize(initial_size);
+    auto keys = sanisizer::create<std::vector<Key_> >(nuniq);
+    sanisizer::resize(counts, nuniq);
+    auto rank = sanisizer::create<std::vector<Code_> >(nuniq);
+    for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+        const auto o = order[u];
+        keys[u] = unsorted_keys[o];
+        counts[u] = unsorted_counts[o];
+        rank[o] = u;
+    }
 
-        if (inner_repeats == 1) {
-            std::iota(out.begin(), out.end(), static_cast<Code_>(0));
-        } else {
-            auto oIt = out.begin();
-            for (Number_ l = 0; l < finfo.second; ++l) {
-                std::fill_n(oIt, inner_repeats, l);
-                oIt += inner_repeats;
+    if (remapping) {
+        for (auto& curremap : *remapping) {
+            for (auto& x : curremap) {
+                x = rank[x];
             }
         }
-        inner_repeats = initial_size;
+    }
+    return keys;
+}
+
+template<typename Key_, typename Code_>
+std::vector<FlatHashMap<Key_, Code_> > create_tile_maps(const std::size_t n, const int num_threads) {
+    std::vector<FlatHashMap<Key_, Code_> > output;
+    output.reserve(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        output.emplace_back(std::min<std::size_t>(n, 1024));
+    }
+    return output;
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Combine multiple categorical variables into a single factor as in `combine_to_factor_unused()`, and count the number of observations for each combination.
+ *
+ * If the number of possible combinations is not much greater than the number of observations, the counts are reported as a dense table.
+ * Otherwise, a sparse table of the observed combinations is reported.
+ * In both cases, the counts are accumulated in the same pass that computes the codes.
+ * For a sparse table, each thread counts its observations in its own hash table, and these are merged at the end.
+ * For a dense table, each thread gets its own table only if there are at least `CrossTabulateOptions::num_threads` observations per combination, otherwise all threads share a single table.
+ *
+ * If the number of possible combinations is too large for `Code_`, the combinations are instead identified by 64-bit keys as in `combine_to_factor_unused_sparse()`.
+ * The combined codes are then the ranks of the observed keys, and a sparse table is always reported.
+ *
+ * For `combine_to_factor()`, the counts for the observed combinations can be directly obtained in the same pass by supplying a `FactorSummary`.
+ *
+ * @tparam Input_ Factor type.
+ * @tparam Number_ Integer type for the number of unique values in each variable.
+ * @tparam Code_ Integer type for the combined factor.
+ * This should be large enough to hold the number of unique observed combinations.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pairs, each of which corresponds to a categorical variable.
+ * See the argument of the same name in `combine_to_factor_unused()` for details.
+ * An error is raised if the product of the number of unique values across all variables cannot be stored in a 64-bit unsigned integer.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ * If `CrossTabulation::overflow = false`, these are the same as the codes computed by `combine_to_factor_unused()`,
+ * otherwise they are the same as the codes computed by `combine_to_factor_unused_sparse()`.
+ * @param options Further options.
+ *
+ * @return Contingency table for all combinations of the input variables.
+ */
+template<typename Input_, typename Number_, typename Code_>
+CrossTabulation<Code_> cross_tabulate(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes, const CrossTabulateOptions& options) {
+    const int num_threads = std::max(1, options.num_threads);
+    CrossTabulation<Code_> output;
+
+    auto space = internal::define_unused_levels<std::uint64_t>(inputs);
+    if (space.size() > static_cast<std::uint64_t>(std::numeric_limits<Code_>::max())) {
+        output.sparse = true;
+        output.overflow = true;
+        auto thread_maps = internal::create_tile_maps<std::uint64_t, Code_>(n, num_threads);
+        auto thread_counts = sanisizer::create<std::vector<std::vector<std::size_t> > >(num_threads);
+        auto block_ranges = sanisizer::create<std::vector<std::pair<std::size_t, std::size_t> > >(num_threads);
+        std::uint64_t* const no_keys = NULL; // keys only live in each thread's tile buffer.
+        internal::fill_unused_codes(n, inputs, space.strides(), no_keys, num_threads, [&](const int t, const std::size_t tile_start, const std::uint64_t* const tile_keys, const std::size_t tile_length) -> void {
+            auto& range = block_ranges[t];
+            if (range.second == 0) {
+                range.first = tile_start;
+            }
+            range.second += tile_length;
+            internal::count_tile_keys(thread_maps[t], thread_counts[t], tile_keys, tile_length, codes + tile_start);
+        });
+
+        std::vector<std::vector<Code_> > remapping;
+        auto keys = internal::merge_tile_keys(thread_maps, thread_counts, output.counts, &remapping);
+        output.observed = SparseCartesianLevels<Code_>(std::move(space), std::move(keys)); // checks that the number of observed combinations fits in Code_.
+        internal::remap_blocks(codes, block_ranges, remapping, 0, num_threads);
+        return output;
+    }
+
+    output.levels = internal::define_unused_levels<Code_>(inputs);
+    const auto ncombos = output.levels.size();
+    const auto& strides = output.levels.strides();
+
+    if (static_cast<double>(ncombos) <= options.max_dense_ratio * static_cast<double>(n)) {
+        // Each thread only gets its own table if the total size of all tables is no greater than 'n', like the presence arrays in find_present_offsets().
+        // Otherwise, all threads increment a single shared table. Contention should be low here as there are many combinations per thread.
+        if (num_threads == 1 || static_cast<std::size_t>(num_threads) <= n / ncombos) {
+            // Each thread's table is allocated inside the thread, so that its pages are local to that thread.
+            auto thread_counts = sanisizer::create<std::vector<std::vector<std::size_t> > >(num_threads);
+            internal::fill_unused_codes(n, inputs, strides, codes, num_threads, [&](const int t, const std::size_t, const Code_* const tile_codes, const std::size_t tile_length) -> void {
+                auto& curcounts = thread_counts[t];
+                if (curcounts.empty()) {
+                    sanisizer::resize(curcounts, ncombos);
+                }
+                for (I<decltype(tile_length)> i = 0; i < tile_length; ++i) {
+                    ++curcounts[tile_codes[i]];
+                }
+            });
+
+            output.counts.swap(thread_counts[0]);
+            sanisizer::resize(output.counts, ncombos); // in case thread 0 didn't get any observations.
+            subpar::parallelize_range(num_threads, ncombos, [&](const int, const Code_ start, const Code_ length) -> void {
+                for (int t = 1; t < num_threads; ++t) {
+                    const auto& curcounts = thread_counts[t];
+                    if (curcounts.empty()) {
+                        continue;
+                    }
+                    for (I<decltype(start)> c = start, end = start + length; c < end; ++c) {
+                        output.counts[c] += curcounts[c];
+                    }
+                }
+            });
+
+        } else {
+            auto shared_counts = sanisizer::create<std::vector<std::atomic<std::size_t> > >(ncombos);
+            internal::fill_unused_codes(n, inputs, strides, codes, num_threads, [&](const int, const std::size_t, const Code_* const tile_codes, const std::size_t tile_length) -> void {
+                for (I<decltype(tile_length)> i = 0; i < tile_length; ++i) {
+                    shared_counts[tile_codes[i]].fetch_add(1, std::memory_order_relaxed);
+                }
+            });
 
-        outer_repeats /= finfo.second;
-        for (Code_ r = 1; r < outer_repeats; ++r) {
-            // Referencing to 'begin()' while inserting is safe, as we reserved the full length at the start.
-            // Thus, there shouldn't be any allocations.
-            out.insert(out.end(), out.begin(), out.begin() + initial_size);
+            sanisizer::resize(output.counts, ncombos);
+            subpar::parallelize_range(num_threads, ncombos, [&](const int, const Code_ start, const Code_ length) -> void {
+                for (I<decltype(start)> c = start, end = start + length; c < end; ++c) {
+                    output.counts[c] = shared_counts[c].load(std::memory_order_relaxed);
+                }
+            });
         }
+
+    } else {
+        output.sparse = true;
+        auto thread_maps = internal::create_tile_maps<Code_, Code_>(n, num_threads);
+        auto thread_counts = sanisizer::create<std::vector<std::vector<std::size_t> > >(num_threads);
+        internal::fill_unused_codes(n, inputs, strides, codes, num_threads, [&](const int t, const std::size_t, const Code_* const tile_codes, const std::size_t tile_length) -> void {
+            internal::count_tile_keys<Code_, Code_>(thread_maps[t], thread_counts[t], tile_codes, tile_length, NULL);
+        });
+        output.combinations = internal::merge_tile_keys<Code_, Code_>(thread_maps, thread_counts, output.counts, NULL);
     }
 
     return output;
 }
 
+/**
+ * Overload of `cross_tabulate()` with default options.
+ *
+ * @tparam Input_ Factor type.
+ * @tparam Number_ Integer type for the number of unique values in each variable.
+ * @tparam Code_ Integer type for the combined factor.
+ *
+ * @param n Number of observations (i.e., cells).
+ * @param[in] inputs Vector of pairs, each of which corresponds to a categorical variable.
+ * See the argument of the same name in `combine_to_factor_unused()` for details.
+ * @param[out] codes Pointer to an array of length `n` in which the codes of the combined factor are to be stored.
+ *
+ * @return Contingency table for all combinations of the input variables.
+ */
+template<typename Input_, typename Number_, typename Code_>
+CrossTabulation<Code_> cross_tabulate(const std::size_t n, const std::vector<std::pair<const Input_*, Number_> >& inputs, Code_* const codes) {
+    return cross_tabulate(n, inputs, codes, CrossTabulateOptions());
+}
+
 }
 
 #endif
@@ -1,14 +1,20 @@
 #ifndef FACTORIZE_CLEAN_FACTOR_HPP
 #define FACTORIZE_CLEAN_FACTOR_HPP
 
-#include <unordered_map>
 #include <vector>
 #include <algorithm>
+#include <queue>
+#include <type_traits>
+#include <limits>
 #include <cstddef>
+#include <cstdint>
 
 #include "sanisizer/sanisizer.hpp"
+#include "subpar/subpar.hpp"
 
 #include "utils.hpp"
+#include "FlatHashMap.hpp"
+#include "radix_sort.hpp"
 
 /**
  * @file create_factor.hpp
@@ -17,11 +23,636 @@
 
 namespace factorize {
 
+/**
+ * Strategy for identifying the unique levels in `create_factor()`.
+ *
+ * - `HASH`: build a hash table of the unique values, and then sort the unique values.
+ *   This is efficient when the number of unique values is much smaller than the number of observations.
+ * - `SORT`: radix sort the observations by their bit patterns and read off the unique values.
+ *   This is more efficient when most values are unique, e.g., timestamps or floating-point measurements.
+ *   Only applicable to integer and IEEE floating-point types, otherwise `HASH` is used instead.
+ */
+enum class CreateFactorStrategy : char { HASH, SORT };
+
+/**
+ * @brief Options for `create_factor()`.
+ */
+struct CreateFactorOptions {
+    /**
+     * Strategy for identifying the unique levels.
+     * Regardless of the choice here, integer inputs with a small range are always handled with a lookup table, see `create_factor()` for details.
+     */
+    CreateFactorStrategy strategy = CreateFactorStrategy::HASH;
+
+    /**
+     * Whether to exploit runs of identical values in the input, e.g., when observations are grouped by sample.
+     * If true, we check whether the input is monotonic, in which case the levels and codes are directly obtained in a single linear scan.
+     * Otherwise, the hash-based strategy will reuse the code of the previous observation if it has the same value, skipping the table lookup.
+     * This should be enabled if the input is likely to be sorted or contain long runs, otherwise it just adds some unnecessary comparisons.
+     */
+    bool detect_runs = false;
+
+    /**
+     * Number of threads to use.
+     * The output is the same regardless of the number of threads.
+     * This is currently ignored for `CreateFactorStrategy::SORT`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @brief Per-level summaries of a factor.
+ *
+ * Each vector has length equal to the number of levels, where each entry corresponds to a level in the same order as the output of `create_factor()` or `combine_to_factor()`.
+ */
+struct FactorSummary {
+    /**
+     * Number of observations assigned to each level.
+     */
+    std::vector<std::size_t> counts;
+
+    /**
+     * Index of the first observation assigned to each level.
+     */
+    std::vector<std::size_t> first;
+
+    /**
+     * Index of the last observation assigned to each level.
+     */
+    std::vector<std::size_t> last;
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+inline void resize_summary(FactorSummary& summary, const std::size_t nlevels) {
+    sanisizer::resize(summary.counts, nlevels);
+    std::fill(summary.counts.begin(), summary.counts.end(), 0);
+    sanisizer::resize(summary.first, nlevels);
+    sanisizer::resize(summary.last, nlevels);
+}
+
+// This assumes that observations are added in increasing order of their indices.
+inline void add_to_summary(FactorSummary& summary, const std::size_t code, const std::size_t i) {
+    auto& count = summary.counts[code];
+    if (count == 0) {
+        summary.first[code] = i;
+    }
+    ++count;
+    summary.last[code] = i;
+}
+
+// Sets the summary for a level from a run of consecutive observations in [start, end).
+inline void set_summary_from_run(FactorSummary& summary, const std::size_t code, const std::size_t start, const std::size_t end) {
+    summary.counts[code] = end - start;
+    summary.first[code] = start;
+    summary.last[code] = end - 1;
+}
+
+template<typename Input_>
+constexpr bool is_dense_candidate() {
+    return std::is_integral<Input_>::value && !std::is_same<Input_, bool>::value;
+}
+
+// Working in the unsigned domain so that the range calculation is well-defined for signed types.
+template<typename Input_>
+bool find_dense_range(const std::size_t n, const Input_* const input, const int num_threads, typename std::make_unsigned<Input_>::type& lower, std::size_t& span) {
+    if (n == 0) {
+        return false;
+    }
+
+    typedef typename std::make_unsigned<Input_>::type Unsigned;
+    std::vector<std::pair<Input_, Input_> > block_limits(num_threads, std::make_pair(input[0], input[0]));
+    subpar::parallelize_range(num_threads, n, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+        const auto limits = std::minmax_element(input + start, input + start + length);
+        block_limits[t] = std::make_pair(*(limits.first), *(limits.second));
+    });
+
+    Input_ min_val = block_limits.front().first, max_val = block_limits.front().second;
+    for (const auto& bl : block_limits) {
+        min_val = std::min(min_val, bl.first);
+        max_val = std::max(max_val, bl.second);
+    }
+    lower = min_val;
+    const Unsigned range = static_cast<Unsigned>(max_val) - lower;
+
+    // Only using the lookup table if it is no larger than the input itself,
+    // otherwise we might end up allocating a lot of memory for a few sparse values.
+    if (static_cast<std::uintmax_t>(range) >= static_cast<std::uintmax_t>(n)) {
+        return false;
+    }
+    span = static_cast<std::size_t>(range) + 1;
+    return true;
+}
+
+// Marks each offset in [0, span) that is reported by 'offset' for any observation.
+// Each block gets its own presence array, so we limit the number of blocks to cap the memory usage at 'n' bytes.
+template<class Offset_>
+std::vector<unsigned char> find_present_offsets(const std::size_t n, const std::size_t span, const int num_threads, Offset_ offset) {
+    const int num_presence = std::max(static_cast<std::size_t>(1), std::min(static_cast<std::size_t>(num_threads), n / span));
+    std::vector<std::vector<unsigned char> > block_present(num_presence);
+    subpar::parallelize_range(num_presence, n, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+        auto& curpresent = block_present[t];
+        curpresent.resize(span);
+        for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+            curpresent[offset(i)] = 1;
+        }
+    });
+
+    std::vector<unsigned char> present;
+    present.swap(block_present.front());
+    for (I<decltype(num_presence)> t = 1; t < num_presence; ++t) {
+        const auto& current = block_present[t];
+        if (current.empty()) { // in case subpar decides to use fewer threads than we requested.
+            continue;
+        }
+        for (I<decltype(span)> s = 0; s < span; ++s) {
+            present[s] |= current[s];
+        }
+    }
+    return present;
+}
+
+template<typename Input_, typename Code_>
+bool create_factor_dense(const std::size_t n, const Input_* const input, Code_* const codes, std::vector<Input_>& output, const int num_threads, FactorSummary* const summary) {
+    typedef typename std::make_unsigned<Input_>::type Unsigned;
+    Unsigned lower;
+    std::size_t span;
+    if (!find_dense_range(n, input, num_threads, lower, span)) {
+        return false;
+    }
+
+    const auto offset = [&](const Input_ x) -> std::size_t {
+        return static_cast<Unsigned>(static_cast<Unsigned>(x) - lower);
+    };
+
+    std::vector<unsigned char> present;
+    FactorSummary span_summary;
+    if (summary) {
+        // Tallying the summaries for every value in the range, which also tells us whether each value is present.
+        // This is done in a single pass as the per-value summaries are too large to replicate across threads.
+        resize_summary(span_summary, span);
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            add_to_summary(span_summary, offset(input[i]), i);
+        }
+        sanisizer::resize(present, span);
+        for (I<decltype(span)> s = 0; s < span; ++s) {
+            present[s] = (span_summary.counts[s] > 0);
+        }
+
+    } else {
+        present = find_present_offsets(n, span, num_threads, [&](const std::size_t i) -> std::size_t { return offset(input[i]); });
+    }
+
+    const auto nuniq = std::count(present.begin(), present.end(), 1);
+    output.reserve(nuniq);
+
+    if (static_cast<std::size_t>(nuniq) == span) {
+        // Every value in the range is observed, so the offsets are already the sorted codes.
+        for (I<decltype(span)> s = 0; s < span; ++s) {
+            output.push_back(static_cast<Input_>(static_cast<Unsigned>(lower + s)));
+        }
+        if (summary) {
+            *summary = std::move(span_summary);
+        }
+        subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+            if (lower == 0) {
+                std::copy_n(input + start, length, codes + start);
+            } else {
+                for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+                    codes[i] = offset(input[i]);
+                }
+            }
+        });
+        return true;
+    }
+
+    auto lookup = sanisizer::create<std::vector<Code_> >(span);
+    Code_ counter = 0;
+    if (summary) {
+        resize_summary(*summary, nuniq);
+    }
+    for (I<decltype(span)> s = 0; s < span; ++s) {
+        if (present[s]) {
+            if (summary) {
+                summary->counts[counter] = span_summary.counts[s];
+                summary->first[counter] = span_summary.first[s];
+                summary->last[counter] = span_summary.last[s];
+            }
+            lookup[s] = counter;
+            ++counter;
+            output.push_back(static_cast<Input_>(static_cast<Unsigned>(lower + s)));
+        }
+    }
+
+    subpar::parallelize_range(num_threads, n, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+            codes[i] = lookup[offset(input[i])];
+        }
+    });
+    return true;
+}
+
+// Sorts the keys while keeping track of their original positions, i.e., their pre-sorting codes.
+template<typename Code_, typename Input_>
+std::vector<std::pair<Input_, Code_> > sort_keys(std::vector<Input_> keys) {
+    const auto nkeys = keys.size();
+    std::vector<std::pair<Input_, Code_> > unique;
+    unique.reserve(nkeys);
+    for (I<decltype(nkeys)> k = 0; k < nkeys; ++k) {
+        unique.emplace_back(std::move(keys[k]), k);
+    }
+    std::sort(unique.begin(), unique.end());
+    return unique;
+}
+
+// The 'get' function should return the value (or a const reference to it) for observation 'i' as a 'Key_'.
+// This allows the same code to be used for inputs that need some conversion on access, e.g., strings to string views.
+template<typename Key_, typename Code_, class Get_>
+bool create_factor_monotonic(const std::size_t n, Get_ get, Code_* const codes, std::vector<Key_>& output, FactorSummary* const summary) {
+    if (n == 0) {
+        return false;
+    }
+
+    bool increasing = true, decreasing = true;
+    Code_ num_decreases = 0;
+    for (I<decltype(n)> i = 1; i < n; ++i) {
+        const Key_& previous = get(i - 1);
+        const Key_& current = get(i);
+        if (current < previous) {
+            increasing = false;
+            ++num_decreases;
+        } else if (previous < current) {
+            decreasing = false;
+        } else if (!(previous == current)) {
+            // Incomparable values (e.g., NaNs) would otherwise be merged into their neighbor's run, so we defer to the general path.
+            return false;
+        }
+        if (!increasing && !decreasing) {
+            return false;
+        }
+    }
+
+    // Recording the start of each run in case we need to compute the summaries.
+    std::vector<std::size_t> run_starts;
+    const auto add_run = [&](const std::size_t i) -> void {
+        if (summary) {
+            run_starts.push_back(i);
+        }
+    };
+
+    output.push_back(get(0));
+    add_run(0);
+    if (increasing) {
+        Code_ counter = 0;
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            const Key_& current = get(i);
+            if (output.back() < current) {
+                output.push_back(current);
+                add_run(i);
+                ++counter;
+            }
+            codes[i] = counter;
+        }
+    } else {
+        Code_ counter = num_decreases;
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            const Key_& current = get(i);
+            if (current < output.back()) {
+                output.push_back(current);
+                add_run(i);
+                --counter;
+            }
+            codes[i] = counter;
+        }
+        std::reverse(output.begin(), output.end());
+    }
+
+    if (summary) {
+        const auto nruns = run_starts.size();
+        resize_summary(*summary, nruns);
+        for (I<decltype(nruns)> r = 0; r < nruns; ++r) {
+            const auto code = (increasing ? r : nruns - r - 1);
+            set_summary_from_run(*summary, code, run_starts[r], (r + 1 < nruns ? run_starts[r + 1] : n));
+        }
+    }
+
+    return true;
+}
+
+// Assigns block-specific codes in order of first appearance, returning the unique keys in the same order.
+// If 'summary' is provided, it is filled with the summaries for each block-specific code.
+template<typename Key_, typename Code_, class Get_>
+std::vector<Key_> hash_block(Get_& get, Code_* const codes, const std::size_t start, const std::size_t length, const bool detect_runs, FactorSummary* const summary) {
+    // Starting with a modest table and letting it grow, as low-cardinality inputs would not benefit from an 'n'-sized table.
+    FlatHashMap<Key_, Code_> mapping(std::min<std::size_t>(length, 1024));
+    const auto end = start + length;
+
+    const auto update_summary = [&](const std::size_t i) -> void {
+        if (summary) {
+            const std::size_t code = codes[i];
+            if (code == summary->counts.size()) {
+                summary->counts.push_back(0);
+                summary->first.push_back(i);
+                summary->last.push_back(i);
+            }
+            add_to_summary(*summary, code, i);
+        }
+    };
+
+    if (detect_runs) {
+        for (I<decltype(start)> i = start; i < end; ++i) {
+            const Key_& current = get(i);
+            if (i > start && current == get(i - 1)) {
+                codes[i] = codes[i - 1];
+            } else {
+                codes[i] = mapping.insert(current).first;
+            }
+            update_summary(i);
+        }
+    } else {
+        for (I<decltype(start)> i = start; i < end; ++i) {
+            codes[i] = mapping.insert(get(i)).first;
+            update_summary(i);
+        }
+    }
+
+    return mapping.release();
+}
+
+template<typename Code_>
+void remap_blocks(
+    Code_* const codes,
+    const std::vector<std::pair<std::size_t, std::size_t> >& block_ranges,
+    const std::vector<std::vector<Code_> >& block_remapping,
+    const std::size_t first_block,
+    const int num_threads)
+{
+    subpar::parallelize_range(num_threads, block_ranges.size() - first_block, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        for (I<decltype(start)> t = start + first_block, end = start + first_block + length; t < end; ++t) {
+            const auto& remapping = block_remapping[t];
+            const auto& range = block_ranges[t];
+            for (I<decltype(range.first)> i = range.first, iend = range.first + range.second; i < iend; ++i) {
+                codes[i] = remapping[codes[i]];
+            }
+        }
+    });
+}
+
+// Blocks are processed in order, so the first block containing a level defines its first occurrence, and the last block defines its last occurrence.
+template<typename Code_>
+void merge_block_summaries(const std::vector<std::vector<Code_> >& block_remapping, const std::vector<FactorSummary>& block_summaries, const std::size_t nlevels, FactorSummary& summary) {
+    resize_summary(summary, nlevels);
+    const auto nblocks = block_remapping.size();
+    for (I<decltype(nblocks)> t = 0; t < nblocks; ++t) {
+        const auto& remapping = block_remapping[t];
+        const auto& bsummary = block_summaries[t];
+        const auto nlocal = remapping.size();
+        for (I<decltype(nlocal)> l = 0; l < nlocal; ++l) {
+            const auto code = remapping[l];
+            auto& count = summary.counts[code];
+            if (count == 0) {
+                summary.first[code] = bsummary.first[l];
+            }
+            count += bsummary.counts[l];
+            summary.last[code] = bsummary.last[l];
+        }
+    }
+}
+
+template<typename Key_, typename Code_, class Get_>
+std::vector<Key_> create_factor_hash(const std::size_t n, Get_ get, Code_* const codes, const int num_threads, const bool detect_runs, FactorSummary* const summary) {
+    // Each thread builds its own table for a contiguous block of observations, assigning block-specific codes.
+    // The keys of each table are then sorted so that we can merge them into a single set of sorted levels.
+    std::vector<std::vector<std::pair<Key_, Code_> > > block_unique(num_threads);
+    std::vector<std::pair<std::size_t, std::size_t> > block_ranges(num_threads);
+    std::vector<FactorSummary> block_summaries(summary ? num_threads : 0);
+    subpar::parallelize_range(num_threads, n, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+        block_ranges[t] = std::make_pair(start, length);
+        block_unique[t] = sort_keys<Code_>(hash_block<Key_>(get, codes, start, length, detect_runs, (summary ? block_summaries.data() + t : NULL)));
+    });
+
+    // Merging the sorted keys across blocks to obtain the levels, and filling each block's remapping from block-specific to sorted codes.
+    std::vector<Key_> output;
+    std::vector<std::vector<Code_> > block_remapping(num_threads);
+    if (num_threads == 1) {
+        auto& unique = block_unique.front();
+        const auto nuniq = unique.size();
+        auto& remapping = block_remapping.front();
+        sanisizer::resize(remapping, nuniq);
+        sanisizer::resize(output, nuniq);
+        for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
+            remapping[unique[u].second] = u;
+            output[u] = std::move(unique[u].first);
+        }
+
+    } else {
+        // Ties are broken by block so that each level is represented by its first occurrence, regardless of the number of threads.
+        // This matters for values that compare equal but are still distinguishable, e.g., -0.0 and +0.0.
+        typedef std::pair<int, std::size_t> Cursor;
+        auto cmp = [&](const Cursor& left, const Cursor& right) -> bool {
+            const auto& lval = block_unique[left.first][left.second].first;
+            const auto& rval = block_unique[right.first][right.second].first;
+            if (rval < lval) {
+                return true;
+            } else if (lval < rval) {
+                return false;
+            }
+            return right.first < left.first;
+        };
+        std::priority_queue<Cursor, std::vector<Cursor>, I<decltype(cmp)> > heap(std::move(cmp));
+        for (int t = 0; t < num_threads; ++t) {
+            const auto& unique = block_unique[t];
+            sanisizer::resize(block_remapping[t], unique.size());
+            if (!unique.empty()) {
+                heap.emplace(t, 0);
+            }
+        }
+
+        while (!heap.empty()) {
+            const auto current = heap.top();
+            heap.pop();
+            auto& entry = block_unique[current.first][current.second];
+            if (output.empty() || output.back() < entry.first) {
+                output.push_back(std::move(entry.first));
+            }
+            block_remapping[current.first][entry.second] = output.size() - 1;
+            const auto next = current.second + 1;
+            if (next < block_unique[current.first].size()) {
+                heap.emplace(current.first, next);
+            }
+        }
+    }
+
+    if (summary) {
+        merge_block_summaries(block_remapping, block_summaries, output.size(), *summary);
+    }
+
+    // Mapping each cell to its sorted factor.
+    remap_blocks(codes, block_ranges, block_remapping, 0, num_threads);
+    return output;
+}
+
+template<typename Key_, typename Code_, class Get_>
+std::vector<Key_> create_factor_hash_unsorted(const std::size_t n, Get_ get, Code_* const codes, const int num_threads, const bool detect_runs) {
+    std::vector<std::vector<Key_> > block_keys(num_threads);
+    std::vector<std::pair<std::size_t, std::size_t> > block_ranges(num_threads);
+    subpar::parallelize_range(num_threads, n, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+        block_ranges[t] = std::make_pair(start, length);
+        block_keys[t] = hash_block<Key_>(get, codes, start, length, detect_runs, NULL);
+    });
+    if (num_threads == 1) {
+        return std::move(block_keys.front());
+    }
+
+    // Inserting each block's keys in order, so that the global order of insertion is the same as the order of first appearance.
+    // This means that the first block's codes don't need to be remapped.
+    FlatHashMap<Key_, Code_> mapping(block_keys.front().size());
+    std::vector<std::vector<Code_> > block_remapping(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        const auto& keys = block_keys[t];
+        auto& remapping = block_remapping[t];
+        sanisizer::resize(remapping, keys.size());
+        const auto nkeys = keys.size();
+        for (I<decltype(nkeys)> k = 0; k < nkeys; ++k) {
+            remapping[k] = mapping.insert(keys[k]).first;
+        }
+    }
+
+    remap_blocks(codes, block_ranges, block_remapping, 1, num_threads);
+    return mapping.release();
+}
+
+template<typename Input_, typename Code_>
+bool create_factor_dense_unsorted(const std::size_t n, const Input_* const input, Code_* const codes, std::vector<Input_>& output, const int num_threads) {
+    typedef typename std::make_unsigned<Input_>::type Unsigned;
+    Unsigned lower;
+    std::size_t span;
+    if (!find_dense_range(n, input, num_threads, lower, span)) {
+        return false;
+    }
+
+    // Storing the code plus 1 in the lookup table, so that zero can be used to indicate that a value has not been seen yet.
+    // This needs to be wider than Code_, otherwise the last code would wrap around to zero.
+    auto lookup = sanisizer::create<std::vector<std::size_t> >(span);
+    for (I<decltype(n)> i = 0; i < n; ++i) {
+        auto& current = lookup[static_cast<Unsigned>(static_cast<Unsigned>(input[i]) - lower)];
+        if (current == 0) {
+            output.push_back(input[i]);
+            current = output.size();
+        }
+        codes[i] = current - 1;
+    }
+
+    return true;
+}
+
+template<typename Index_, typename Input_, typename Code_>
+std::vector<Input_> create_factor_sort(const std::size_t n, const Input_* const input, Code_* const codes, FactorSummary* const summary) {
+    typedef typename RadixKey<Input_>::Type Key;
+    auto keys = sanisizer::create<std::vector<Key> >(n);
+    auto indices = sanisizer::create<std::vector<Index_> >(n);
+    for (I<decltype(n)> i = 0; i < n; ++i) {
+        keys[i] = to_radix_key(input[i]);
+        indices[i] = i;
+    }
+
+    {
+        std::vector<Key> key_buffer;
+        std::vector<Index_> index_buffer;
+        radix_sort(keys, indices, key_buffer, index_buffer);
+    }
+
+    // Walking through the sorted keys to identify the unique values and scatter their codes.
+    // As the sort is stable, the indices within each run of identical keys are in increasing order.
+    std::vector<Input_> output;
+    Code_ counter = 0;
+    if (summary) {
+        resize_summary(*summary, 0);
+    }
+    for (I<decltype(n)> i = 0; i < n; ++i) {
+        const std::size_t current = indices[i];
+        if (i == 0 || keys[i] != keys[i - 1]) {
+            if (i) {
+                ++counter;
+            }
+            output.push_back(input[current]);
+            if (summary) {
+                summary->counts.push_back(0);
+                summary->first.push_back(current);
+                summary->last.push_back(current);
+            }
+        }
+        codes[current] = counter;
+        if (summary) {
+            ++(summary->counts.back());
+            summary->last.back() = current;
+        }
+    }
+
+    return output;
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Input_, typename Code_>
+std::vector<Input_> create_factor(const std::size_t n, const Input_* const input, Code_* const codes, const CreateFactorOptions& options, FactorSummary* const summary) {
+    const int num_threads = std::max(1, options.num_threads);
+    const auto get = [&](const std::size_t i) -> const Input_& { return input[i]; };
+
+    if (options.detect_runs) {
+        std::vector<Input_> output;
+        if (create_factor_monotonic(n, get, codes, output, summary)) {
+            return output;
+        }
+    }
+
+    if constexpr(is_dense_candidate<Input_>()) {
+        std::vector<Input_> output;
+        if (create_factor_dense(n, input, codes, output, num_threads, summary)) {
+            return output;
+        }
+    }
+
+    if constexpr(is_radix_sortable<Input_>()) {
+        if (options.strategy == CreateFactorStrategy::SORT) {
+            // Using a smaller index type if possible, to reduce memory usage and traffic.
+            if (static_cast<std::uintmax_t>(n) <= static_cast<std::uintmax_t>(std::numeric_limits<std::uint32_t>::max())) {
+                return create_factor_sort<std::uint32_t>(n, input, codes, summary);
+            } else {
+                return create_factor_sort<std::size_t>(n, input, codes, summary);
+            }
+        }
+    }
+
+    return create_factor_hash<Input_>(n, get, codes, num_threads, options.detect_runs, summary);
+}
+
+}
+/**
+ * @endcond
+ */
+
 /**
  * Convert a categorical variable into a factor.
  * Factors are defined in a similar manner as in the R programming language,
  * i.e., an array of integer codes, each of which reference into an array of unique levels.
  *
+ * For integer `Input_`, we first check whether the observed range of values is no greater than `n`.
+ * If so, the codes are directly computed from a lookup table spanning that range, which avoids the cost of hashing and sorting.
+ * If `input` is already a compact factor, i.e., every integer in \f$[0, N)\f$ is observed, it is copied directly into `codes`.
+ * Otherwise, the levels are identified according to `CreateFactorOptions::strategy`.
+ *
  * @tparam Input_ Type of the categorical variable.
  * Any type may be used here as long as it is hashable and has an equality operator.
  * @tparam Code_ Integer type for the output factor codes.
@@ -31,44 +662,130 @@ namespace factorize {
  * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
  * All values are integers in \f$[0, N)\f$ where \f$N\f$ is the length of the output vector;
  * all integers in this range are guaranteed to be present at least once in `cleaned`.
+ * @param options Further options.
  *
  * @return A vector of the unique and sorted values of `input`, i.e., the factor levels.
  * For any observation `i`, it is guaranteed that `output[codes[i]] == input[i]`.
  */
 template<typename Input_, typename Code_>
+std::vector<Input_> create_factor(const std::size_t n, const Input_* const input, Code_* const codes, const CreateFactorOptions& options) {
+    return internal::create_factor(n, input, codes, options, NULL);
+}
+
+/**
+ * Overload of `create_factor()` that also computes per-level summaries.
+ * This avoids an extra pass over the codes to compute the number of observations and the first/last occurrence of each level.
+ *
+ * @tparam Input_ Type of the categorical variable.
+ * @tparam Code_ Integer type for the output factor codes.
+ *
+ * @param n Number of observations. 
+ * @param[in] input Pointer to an array of length `n` containing the input categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
+ * @param options Further options.
+ * @param[out] summary Per-level summaries.
+ * On output, each vector has length equal to the number of levels.
+ *
+ * @return A vector of the unique and sorted values of `input`.
+ */
+template<typename Input_, typename Code_>
+std::vector<Input_> create_factor(const std::size_t n, const Input_* const input, Code_* const codes, const CreateFactorOptions& options, FactorSummary& summary) {
+    return internal::create_factor(n, input, codes, options, &summary);
+}
+
+/**
+ * Overload of `create_factor()` with default options.
+ *
+ * @tparam Input_ Type of the categorical variable.
+ * @tparam Code_ Integer type for the output factor codes.
+ *
+ * @param n Number of observations. 
+ * @param[in] input Pointer to an array of length `n` containing the input categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
+ *
+ * @return A vector of the unique and sorted values of `input`.
+ */
+template<typename Input_, typename Code_>
 std::vector<Input_> create_factor(const std::size_t n, const Input_* const input, Code_* const codes) {
-    auto unique = [&]{ // scoping this in an IIFE to release map memory sooner.
-        std::unordered_map<Input_, Code_> mapping;
-        for (I<decltype(n)> i = 0; i < n; ++i) {
-            const auto current = input[i];
-            const auto mIt = mapping.find(current);
-            if (mIt != mapping.end()) {
-                codes[i] = mIt->second;
-            } else {
-                Code_ alt = mapping.size();
-                mapping[current] = alt;
-                codes[i] = alt;
-            }
+    return create_factor(n, input, codes, CreateFactorOptions());
+}
+
+/**
+ * Convert a categorical variable into a factor where the levels are ordered by their first appearance in `input`.
+ * This is faster than `create_factor()` as it skips the sorting of the levels and the subsequent remapping of the codes,
+ * which is useful when the caller only needs consistent codes.
+ * If sorted levels are required later, callers can use `sort_levels()` to obtain the sorted levels and a remapping for the codes.
+ *
+ * @tparam Input_ Type of the categorical variable.
+ * Any type may be used here as long as it is hashable and has an equality operator.
+ * @tparam Code_ Integer type for the output factor codes.
+ *
+ * @param n Number of observations.
+ * @param[in] input Pointer to an array of length `n` containing the input categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
+ * All values are integers in \f$[0, N)\f$ where \f$N\f$ is the length of the output vector.
+ * @param options Further options.
+ * `CreateFactorOptions::strategy` is ignored.
+ * If `CreateFactorOptions::detect_runs = true`, only the reuse of codes for runs of identical values is performed.
+ *
+ * @return A vector of the unique values of `input` in order of their first appearance.
+ * For any observation `i`, it is guaranteed that `output[codes[i]] == input[i]`.
+ */
+template<typename Input_, typename Code_>
+std::vector<Input_> create_factor_unsorted(const std::size_t n, const Input_* const input, Code_* const codes, const CreateFactorOptions& options) {
+    const int num_threads = std::max(1, options.num_threads);
+    if constexpr(internal::is_dense_candidate<Input_>()) {
+        std::vector<Input_> output;
+        if (internal::create_factor_dense_unsorted(n, input, codes, output, num_threads)) {
+            return output;
         }
-        return std::vector<std::pair<Input_, Code_> >(mapping.begin(), mapping.end());
-    }();
+    }
 
-    // Remapping to a sorted set.
-    std::sort(unique.begin(), unique.end());
+    const auto get = [&](const std::size_t i) -> const Input_& { return input[i]; };
+    return internal::create_factor_hash_unsorted<Input_>(n, get, codes, num_threads, options.detect_runs);
+}
+
+/**
+ * Overload of `create_factor_unsorted()` with default options.
+ *
+ * @tparam Input_ Type of the categorical variable.
+ * @tparam Code_ Integer type for the output factor codes.
+ *
+ * @param n Number of observations.
+ * @param[in] input Pointer to an array of length `n` containing the input categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
+ *
+ * @return A vector of the unique values of `input` in order of their first appearance.
+ */
+template<typename Input_, typename Code_>
+std::vector<Input_> create_factor_unsorted(const std::size_t n, const Input_* const input, Code_* const codes) {
+    return create_factor_unsorted(n, input, codes, CreateFactorOptions());
+}
+
+/**
+ * Sort the levels of a factor, e.g., from `create_factor_unsorted()`.
+ *
+ * @tparam Code_ Integer type for the factor codes.
+ * @tparam Input_ Type of the categorical variable.
+ *
+ * @param[in,out] levels Vector of unique levels.
+ * On output, this is sorted in increasing order.
+ *
+ * @return Vector of length equal to `levels.size()`, mapping each original code to its code in the sorted levels.
+ * Specifically, the original level `l` is now located at `levels[output[l]]`.
+ * Callers can then apply this remapping to existing codes, i.e., `codes[i] = output[codes[i]]`.
+ */
+template<typename Code_, typename Input_>
+std::vector<Code_> sort_levels(std::vector<Input_>& levels) {
+    auto unique = internal::sort_keys<Code_>(std::move(levels));
     const auto nuniq = unique.size();
     auto remapping = sanisizer::create<std::vector<Code_> >(nuniq);
-    auto output = sanisizer::create<std::vector<Input_> >(nuniq);
+    sanisizer::resize(levels, nuniq);
     for (I<decltype(nuniq)> u = 0; u < nuniq; ++u) {
         remapping[unique[u].second] = u;
-        output[u] = unique[u].first;
-    }
-
-    // Mapping each cell to its sorted factor.
-    for (I<decltype(n)> i = 0; i < n; ++i) {
-        codes[i] = remapping[codes[i]];
+        levels[u] = std::move(unique[u].first);
     }
-
-    return output;
+    return remapping;
 }
 
 }
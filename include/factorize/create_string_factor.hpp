@@ -0,0 +1,164 @@
+#ifndef FACTORIZE_CREATE_STRING_FACTOR_HPP
+#define FACTORIZE_CREATE_STRING_FACTOR_HPP
+
+#include <vector>
+#include <string_view>
+#include <algorithm>
+#include <cstddef>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "utils.hpp"
+#include "create_factor.hpp"
+
+/**
+ * @file create_string_factor.hpp
+ * @brief Create a factor from a string-valued categorical variable.
+ */
+
+namespace factorize {
+
+/**
+ * @brief Levels of a string factor.
+ *
+ * All levels are stored in a single contiguous buffer, avoiding the overhead of many small allocations for short strings.
+ */
+class StringLevels {
+public:
+    /**
+     * @cond
+     */
+    StringLevels() = default;
+
+    StringLevels(const std::vector<std::string_view>& levels) {
+        const auto nlevels = levels.size();
+        sanisizer::resize(my_offsets, sanisizer::sum<std::size_t>(nlevels, 1));
+        for (I<decltype(nlevels)> l = 0; l < nlevels; ++l) {
+            my_offsets[l + 1] = sanisizer::sum<std::size_t>(my_offsets[l], levels[l].size());
+        }
+
+        sanisizer::resize(my_buffer, my_offsets.back());
+        for (I<decltype(nlevels)> l = 0; l < nlevels; ++l) {
+            std::copy(levels[l].begin(), levels[l].end(), my_buffer.begin() + my_offsets[l]);
+        }
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    std::vector<char> my_buffer;
+    std::vector<std::size_t> my_offsets = std::vector<std::size_t>(1);
+
+public:
+    /**
+     * @return Number of levels.
+     */
+    std::size_t size() const {
+        return my_offsets.size() - 1;
+    }
+
+    /**
+     * @param i Index of the level, less than `size()`.
+     * @return View of the string for level `i`.
+     * This remains valid for the lifetime of this `StringLevels` object.
+     */
+    std::string_view operator[](const std::size_t i) const {
+        return std::string_view(my_buffer.data() + my_offsets[i], my_offsets[i + 1] - my_offsets[i]);
+    }
+
+    /**
+     * @return Vector of views of all levels.
+     */
+    std::vector<std::string_view> views() const {
+        const auto nlevels = size();
+        std::vector<std::string_view> output;
+        output.reserve(nlevels);
+        for (I<decltype(nlevels)> l = 0; l < nlevels; ++l) {
+            output.push_back((*this)[l]);
+        }
+        return output;
+    }
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Code_, class Get_>
+StringLevels create_string_factor(const std::size_t n, Get_ get, Code_* const codes, const CreateFactorOptions& options) {
+    const int num_threads = std::max(1, options.num_threads);
+    std::vector<std::string_view> levels;
+    if (!options.detect_runs || !create_factor_monotonic(n, get, codes, levels, NULL)) {
+        levels = create_factor_hash<std::string_view>(n, get, codes, num_threads, options.detect_runs, NULL);
+    }
+    return StringLevels(levels);
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Convert a string-valued categorical variable into a factor.
+ * This is similar to `create_factor()`, but the hash table holds views into the caller's strings rather than copies,
+ * and the levels are stored in a single contiguous buffer instead of many heap-allocated strings.
+ *
+ * @tparam String_ Any string type that can be converted to a `std::string_view`, e.g., `std::string`, `std::string_view` or `const char*`.
+ * @tparam Code_ Integer type for the output factor codes.
+ *
+ * @param n Number of observations.
+ * @param[in] input Pointer to an array of length `n` containing the input categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
+ * @param options Further options.
+ * `CreateFactorOptions::strategy` is ignored as only the hash-based strategy is available for strings.
+ *
+ * @return The unique and sorted strings in `input`, i.e., the factor levels.
+ * For any observation `i`, it is guaranteed that `output[codes[i]] == input[i]`.
+ */
+template<typename String_, typename Code_>
+StringLevels create_string_factor(const std::size_t n, const String_* const input, Code_* const codes, const CreateFactorOptions& options) {
+    return internal::create_string_factor(n, [&](const std::size_t i) -> std::string_view { return std::string_view(input[i]); }, codes, options);
+}
+
+/**
+ * Overload of `create_string_factor()` with default options.
+ *
+ * @tparam String_ Any string type that can be converted to a `std::string_view`.
+ * @tparam Code_ Integer type for the output factor codes.
+ *
+ * @param n Number of observations.
+ * @param[in] input Pointer to an array of length `n` containing the input categorical variable.
+ * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
+ *
+ * @return The unique and sorted strings in `input`.
+ */
+template<typename String_, typename Code_>
+StringLevels create_string_factor(const std::size_t n, const String_* const input, Code_* const codes) {
+    return create_string_factor(n, input, codes, CreateFactorOptions());
+}
+
+/**
+ * Overload of `create_string_factor()` for strings supplied as pointers and lengths,
+ * e.g., for strings that are stored in a single buffer that is not null-terminated.
+ *
+ * @tparam Code_ Integer type for the output factor codes.
+ *
+ * @param n Number of observations.
+ * @param[in] pointers Pointer to an array of length `n` containing pointers to the start of each observation's string.
+ * @param[in] lengths Pointer to an array of length `n` containing the length of each observation's string.
+ * @param[out] codes Pointer to an array of length `n` in which the factor codes are to be stored.
+ * @param options Further options.
+ *
+ * @return The unique and sorted strings in the input.
+ */
+template<typename Code_>
+StringLevels create_string_factor(const std::size_t n, const char* const* const pointers, const std::size_t* const lengths, Code_* const codes, const CreateFactorOptions& options = CreateFactorOptions()) {
+    return internal::create_string_factor(n, [&](const std::size_t i) -> std::string_view { return std::string_view(pointers[i], lengths[i]); }, codes, options);
+}
+
+}
+
+#endif
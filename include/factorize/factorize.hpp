@@ -3,6 +3,11 @@
 
 #include "create_factor.hpp"
 #include "combine_to_factor.hpp"
+#include "Factorizer.hpp"
+#include "create_string_factor.hpp"
+#include "LevelIndex.hpp"
+#include "CartesianLevels.hpp"
+#include "SparseCartesianLevels.hpp"
 
 /**
  * @file factorize.hpp
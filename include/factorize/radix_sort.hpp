@@ -0,0 +1,139 @@
+#ifndef FACTORIZE_RADIX_SORT_HPP
+#define FACTORIZE_RADIX_SORT_HPP
+
+#include <vector>
+#include <array>
+#include <limits>
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils.hpp"
+
+/**
+ * @file radix_sort.hpp
+ * @brief Radix sorting of arithmetic keys.
+ */
+
+namespace factorize {
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Input_>
+constexpr bool is_radix_sortable() {
+    if constexpr(std::is_integral<Input_>::value) {
+        return !std::is_same<Input_, bool>::value;
+    } else if constexpr(std::is_floating_point<Input_>::value) {
+        return std::numeric_limits<Input_>::is_iec559 && (sizeof(Input_) == 4 || sizeof(Input_) == 8);
+    } else {
+        return false;
+    }
+}
+
+template<typename Input_>
+struct RadixKey {
+    typedef typename std::conditional<sizeof(Input_) <= 4, typename std::conditional<sizeof(Input_) <= 2, typename std::conditional<sizeof(Input_) == 1, std::uint8_t, std::uint16_t>::type, std::uint32_t>::type, std::uint64_t>::type Type;
+};
+
+// Converts a value into an unsigned integer whose ordering is the same as that of the original values.
+template<typename Input_>
+typename RadixKey<Input_>::Type to_radix_key(const Input_ x) {
+    typedef typename RadixKey<Input_>::Type Key;
+    constexpr Key sign_bit = static_cast<Key>(1) << (std::numeric_limits<Key>::digits - 1);
+
+    if constexpr(std::is_integral<Input_>::value) {
+        const Key bits = static_cast<typename std::make_unsigned<Input_>::type>(x);
+        if constexpr(std::is_signed<Input_>::value) {
+            return bits ^ sign_bit;
+        } else {
+            return bits;
+        }
+
+    } else {
+        if (x == 0) { // treating -0 and +0 as the same value, consistent with the equality operator.
+            return sign_bit;
+        }
+        Key bits;
+        std::memcpy(&bits, &x, sizeof(Key));
+        if (bits & sign_bit) {
+            return ~bits;
+        } else {
+            return bits | sign_bit;
+        }
+    }
+}
+
+// Inverse of to_radix_key() for integer types.
+template<typename Input_>
+Input_ from_radix_key(const typename RadixKey<Input_>::Type key) {
+    static_assert(std::is_integral<Input_>::value);
+    typedef typename RadixKey<Input_>::Type Key;
+    typedef typename std::make_unsigned<Input_>::type Unsigned;
+    if constexpr(std::is_signed<Input_>::value) {
+        constexpr Key sign_bit = static_cast<Key>(1) << (std::numeric_limits<Key>::digits - 1);
+        return static_cast<Input_>(static_cast<Unsigned>(key ^ sign_bit));
+    } else {
+        return static_cast<Input_>(key);
+    }
+}
+
+// Stable LSD radix sort of 'keys' with 8-bit digits, carrying 'indices' along for the ride.
+// Passes for digits that are the same across all keys are skipped, e.g., the upper bytes of small integers.
+template<typename Key_, typename Index_>
+void radix_sort(std::vector<Key_>& keys, std::vector<Index_>& indices, std::vector<Key_>& key_buffer, std::vector<Index_>& index_buffer) {
+    constexpr int num_digits = sizeof(Key_);
+    constexpr std::size_t num_buckets = 256;
+    const auto n = keys.size();
+
+    std::vector<std::array<std::size_t, num_buckets> > histograms(num_digits);
+    for (auto& h : histograms) {
+        h.fill(0);
+    }
+    for (I<decltype(n)> i = 0; i < n; ++i) {
+        const auto current = keys[i];
+        for (int d = 0; d < num_digits; ++d) {
+            ++(histograms[d][(current >> (8 * d)) & 0xFF]);
+        }
+    }
+
+    key_buffer.resize(n);
+    index_buffer.resize(n);
+    for (int d = 0; d < num_digits; ++d) {
+        auto& hist = histograms[d];
+        const auto digit = [&](const Key_ k) -> std::size_t {
+            return (k >> (8 * d)) & 0xFF;
+        };
+        if (n == 0 || hist[digit(keys.front())] == n) {
+            continue;
+        }
+
+        std::size_t accumulated = 0;
+        for (auto& h : hist) {
+            const auto current = h;
+            h = accumulated;
+            accumulated += current;
+        }
+
+        for (I<decltype(n)> i = 0; i < n; ++i) {
+            auto& pos = hist[digit(keys[i])];
+            key_buffer[pos] = keys[i];
+            index_buffer[pos] = indices[i];
+            ++pos;
+        }
+        keys.swap(key_buffer);
+        indices.swap(index_buffer);
+    }
+}
+
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
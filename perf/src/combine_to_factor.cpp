@@ -0,0 +1,330 @@
+#include "factorize/combine_to_factor.hpp"
+
+#include <map>
+#include <vector>
+#include <string>
+#include <array>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <cstddef>
+
+// Reference implementation with a std::map, as used in previous versions of combine_to_factor().
+template<typename Input_, typename Code_>
+std::vector<std::vector<Input_> > reference(const std::size_t n, const std::vector<const Input_*>& inputs, Code_* const codes) {
+    auto cmp = [&](const std::size_t left, const std::size_t right) -> bool {
+        for (auto curf : inputs) {
+            if (curf[left] < curf[right]) {
+                return true;
+            } else if (curf[left] > curf[right]) {
+                return false;
+            }
+        }
+        return false;
+    };
+    std::map<std::size_t, Code_, decltype(cmp)> mapping(cmp);
+    for (std::size_t i = 0; i < n; ++i) {
+        auto mIt = mapping.find(i);
+        if (mIt == mapping.end()) {
+            Code_ alt = mapping.size();
+            mapping.emplace(i, alt);
+            codes[i] = alt;
+        } else {
+            codes[i] = mIt->second;
+        }
+    }
+
+    std::vector<std::vector<Input_> > output(inputs.size());
+    std::vector<Code_> remapping(mapping.size());
+    Code_ counter = 0;
+    for (const auto& m : mapping) {
+        for (std::size_t f = 0; f < inputs.size(); ++f) {
+            output[f].push_back(inputs[f][m.first]);
+        }
+        remapping[m.second] = counter;
+        ++counter;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        codes[i] = remapping[codes[i]];
+    }
+    return output;
+}
+
+template<class Function_>
+double time_it(Function_ fun) {
+    auto start = std::chrono::high_resolution_clock::now();
+    fun();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t n = 10000000;
+    if (argc > 1) {
+        n = std::stoull(argv[1]);
+    }
+
+    std::mt19937_64 rng(12345);
+    std::vector<int> codes(n);
+
+    // Using a scattered set of values so that we don't just hit the dense path for each variable.
+    for (int nlevels : { 10, 200, 5000 }) {
+        std::vector<std::vector<int> > contents(3, std::vector<int>(n));
+        std::vector<const int*> ptrs;
+        for (auto& con : contents) {
+            for (auto& x : con) {
+                x = static_cast<int>(rng() % nlevels) * 997;
+            }
+            ptrs.push_back(con.data());
+        }
+
+        std::size_t ref_size = 0, new_size = 0;
+        const double ref_time = time_it([&]() -> void { ref_size = reference(n, ptrs, codes.data()).front().size(); });
+        const double new_time = time_it([&]() -> void { new_size = factorize::combine_to_factor(n, ptrs, codes.data()).front().size(); });
+
+        factorize::CombineToFactorOptions sopt;
+        sopt.strategy = factorize::CombineToFactorStrategy::SORT;
+        const double sort_time = time_it([&]() -> void { factorize::combine_to_factor(n, ptrs, codes.data(), sopt); });
+
+        factorize::CombineToFactorOptions hopt;
+        hopt.strategy = factorize::CombineToFactorStrategy::HASH;
+        const double hash_time = time_it([&]() -> void { factorize::combine_to_factor(n, ptrs, codes.data(), hopt); });
+        const double unsorted_time = time_it([&]() -> void { factorize::combine_to_factor_unsorted(n, ptrs, codes.data()); });
+
+        std::cout << "levels per variable: " << nlevels << " (combinations: " << new_size << ")" << std::endl;
+        std::cout << "  std::map:            " << ref_time << " s" << std::endl;
+        std::cout << "  mixed-radix keys:    " << new_time << " s" << std::endl;
+        std::cout << "  sort strategy:       " << sort_time << " s" << std::endl;
+        std::cout << "  hash strategy:       " << hash_time << " s" << std::endl;
+        std::cout << "  unsorted:            " << unsorted_time << " s" << std::endl;
+        if (ref_size != new_size) {
+            std::cerr << "mismatch in the number of levels" << std::endl;
+            return 1;
+        }
+    }
+
+    // Compile-time number of variables, where two 32-bit variables are packed into a single word.
+    for (int nlevels : { 200, 5000 }) {
+        std::vector<int> first(n), second(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            first[i] = static_cast<int>(rng() % nlevels) * 997;
+            second[i] = static_cast<int>(rng() % nlevels) * 997;
+        }
+
+        const double vec_time = time_it([&]() -> void { factorize::combine_to_factor(n, std::vector<const int*>{ first.data(), second.data() }, codes.data()); });
+        const double arr_time = time_it([&]() -> void { factorize::combine_to_factor(n, std::array<const int*, 2>{ first.data(), second.data() }, codes.data()); });
+        std::cout << "two variables, " << nlevels << " levels each" << std::endl;
+        std::cout << "  std::vector:         " << vec_time << " s" << std::endl;
+        std::cout << "  std::array:          " << arr_time << " s" << std::endl;
+    }
+
+    // Small-range integers, e.g., cluster and batch identities.
+    {
+        std::vector<int> cluster(n), batch(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            cluster[i] = rng() % 200;
+            batch[i] = rng() % 50;
+        }
+        std::vector<const int*> ptrs{ cluster.data(), batch.data() };
+
+        const double ref_time = time_it([&]() -> void { reference(n, ptrs, codes.data()); });
+        const double new_time = time_it([&]() -> void { factorize::combine_to_factor(n, ptrs, codes.data()); });
+        std::cout << "cluster x batch" << std::endl;
+        std::cout << "  std::map:            " << ref_time << " s" << std::endl;
+        std::cout << "  combine_to_factor:   " << new_time << " s" << std::endl;
+    }
+
+    // Marginal factors for each variable, using strings where factorizing each variable is relatively expensive.
+    {
+        std::vector<std::vector<std::string> > contents(3, std::vector<std::string>(n));
+        std::vector<const std::string*> ptrs;
+        for (auto& con : contents) {
+            for (auto& x : con) {
+                x = "level_" + std::to_string(rng() % 100);
+            }
+            ptrs.push_back(con.data());
+        }
+
+        std::vector<std::vector<int> > marginal_codes(3, std::vector<int>(n));
+        const double separate_time = time_it([&]() -> void {
+            factorize::combine_to_factor(n, ptrs, codes.data());
+            for (std::size_t f = 0; f < ptrs.size(); ++f) {
+                factorize::create_factor(n, ptrs[f], marginal_codes[f].data());
+            }
+        });
+
+        factorize::CombineToFactorMarginals<std::string, int> marginals;
+        const double fused_time = time_it([&]() -> void { factorize::combine_to_factor(n, ptrs, codes.data(), factorize::CombineToFactorOptions(), marginals); });
+
+        std::cout << "combined and marginal factors" << std::endl;
+        std::cout << "  separate calls:      " << separate_time << " s" << std::endl;
+        std::cout << "  marginals:           " << fused_time << " s" << std::endl;
+        if (marginals.codes != marginal_codes) {
+            std::cerr << "mismatch in the marginal codes" << std::endl;
+            return 1;
+        }
+    }
+
+    // Building a blocking factor one variable at a time.
+    {
+        std::vector<std::vector<int> > contents(3, std::vector<int>(n));
+        for (auto& con : contents) {
+            for (auto& x : con) {
+                x = static_cast<int>(rng() % 20) * 997;
+            }
+        }
+
+        std::vector<std::vector<int> > levels;
+        const double full_time = time_it([&]() -> void {
+            std::vector<const int*> ptrs;
+            for (const auto& con : contents) {
+                ptrs.push_back(con.data());
+                levels = factorize::combine_to_factor(n, ptrs, codes.data());
+            }
+        });
+
+        std::vector<int> ext_codes(n);
+        std::vector<std::vector<int> > ext_levels;
+        const double ext_time = time_it([&]() -> void {
+            for (const auto& con : contents) {
+                ext_levels = factorize::extend_combined_factor(n, ext_codes.data(), ext_levels, con.data(), ext_codes.data());
+            }
+        });
+
+        std::cout << "step-by-step blocking factor" << std::endl;
+        std::cout << "  combine_to_factor:   " << full_time << " s" << std::endl;
+        std::cout << "  extend:              " << ext_time << " s" << std::endl;
+        if (ext_levels != levels || ext_codes != codes) {
+            std::cerr << "mismatch in the extended factor" << std::endl;
+            return 1;
+        }
+    }
+
+    // Nested variables, e.g., lanes within runs and samples within donors.
+    {
+        std::vector<int> run(n), lane(n), donor(n), sample(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            lane[i] = static_cast<int>(rng() % 500) * 997;
+            run[i] = lane[i] % 50;
+            sample[i] = static_cast<int>(rng() % 500) * 997;
+            donor[i] = sample[i] % 20;
+        }
+        std::vector<const int*> ptrs{ donor.data(), sample.data(), run.data(), lane.data() };
+
+        std::vector<int> ref_codes(n);
+        const double full_time = time_it([&]() -> void { factorize::combine_to_factor(n, ptrs, ref_codes.data()); });
+        factorize::CombineToFactorOptions nopt;
+        nopt.detect_nested = true;
+        const double nested_time = time_it([&]() -> void { factorize::combine_to_factor(n, ptrs, codes.data(), nopt); });
+
+        std::cout << "nested variables" << std::endl;
+        std::cout << "  combine_to_factor:   " << full_time << " s" << std::endl;
+        std::cout << "  detect_nested:       " << nested_time << " s" << std::endl;
+        if (ref_codes != codes) {
+            std::cerr << "mismatch in the nested codes" << std::endl;
+            return 1;
+        }
+    }
+
+    // Contingency table for all combinations.
+    {
+        std::vector<std::vector<int> > contents(3, std::vector<int>(n));
+        std::vector<std::pair<const int*, int> > inputs;
+        for (int nlevels : { 20, 30, 50 }) {
+            auto& con = contents[inputs.size()];
+            for (auto& x : con) {
+                x = rng() % nlevels;
+            }
+            inputs.emplace_back(con.data(), nlevels);
+        }
+
+        std::vector<std::size_t> ref_counts;
+        const double separate_time = time_it([&]() -> void {
+            auto levels = factorize::combine_to_factor_unused_lazy(n, inputs, codes.data());
+            ref_counts.resize(levels.size());
+            for (std::size_t i = 0; i < n; ++i) {
+                ++ref_counts[codes[i]];
+            }
+        });
+
+        factorize::CrossTabulation<int> tab;
+        const double fused_time = time_it([&]() -> void { tab = factorize::cross_tabulate(n, inputs, codes.data()); });
+
+        std::cout << "contingency table" << std::endl;
+        std::cout << "  separate pass:       " << separate_time << " s" << std::endl;
+        std::cout << "  cross_tabulate:      " << fused_time << " s" << std::endl;
+        if (tab.counts != ref_counts) {
+            std::cerr << "mismatch in the counts" << std::endl;
+            return 1;
+        }
+    }
+
+    // Sparse contingency table, where most combinations are unobserved.
+    {
+        std::vector<std::vector<int> > contents(3, std::vector<int>(n));
+        std::vector<std::pair<const int*, int> > inputs;
+        for (int nlevels : { 1000, 1000, 1000 }) {
+            auto& con = contents[inputs.size()];
+            for (auto& x : con) {
+                x = rng() % 50;
+            }
+            inputs.emplace_back(con.data(), nlevels);
+        }
+
+        std::size_t ref_size = 0;
+        const double separate_time = time_it([&]() -> void {
+            std::vector<int> scratch(n);
+            factorize::combine_to_factor_unused_lazy(n, inputs, codes.data());
+            ref_size = factorize::create_factor(n, codes.data(), scratch.data()).size();
+        });
+
+        factorize::CrossTabulation<int> tab;
+        const double sparse_time = time_it([&]() -> void { tab = factorize::cross_tabulate(n, inputs, codes.data()); });
+
+        std::cout << "sparse contingency table" << std::endl;
+        std::cout << "  separate pass:       " << separate_time << " s" << std::endl;
+        std::cout << "  cross_tabulate:      " << sparse_time << " s" << std::endl;
+        if (!tab.sparse || tab.counts.size() != ref_size) {
+            std::cerr << "mismatch in the number of combinations" << std::endl;
+            return 1;
+        }
+    }
+
+    // Decoding the combined codes back into per-variable codes.
+    {
+        std::vector<std::vector<int> > contents(3, std::vector<int>(n));
+        std::vector<std::pair<const int*, int> > inputs;
+        for (int nlevels : { 7, 641, 37 }) {
+            auto& con = contents[inputs.size()];
+            for (auto& x : con) {
+                x = rng() % nlevels;
+            }
+            inputs.emplace_back(con.data(), nlevels);
+        }
+        auto levels = factorize::combine_to_factor_unused_lazy(n, inputs, codes.data());
+
+        std::vector<std::vector<int> > decoded(3, std::vector<int>(n));
+        const double naive_time = time_it([&]() -> void {
+            const auto& strides = levels.strides();
+            const auto& counts = levels.counts();
+            for (std::size_t f = 0; f < 3; ++f) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    decoded[f][i] = (codes[i] / strides[f]) % counts[f];
+                }
+            }
+        });
+
+        std::vector<int*> ptrs{ decoded[0].data(), decoded[1].data(), decoded[2].data() };
+        const double fast_time = time_it([&]() -> void { levels.decode(n, codes.data(), ptrs); });
+
+        std::cout << "decoding three variables" << std::endl;
+        std::cout << "  division:            " << naive_time << " s" << std::endl;
+        std::cout << "  CartesianLevels:     " << fast_time << " s" << std::endl;
+        if (decoded != contents) {
+            std::cerr << "mismatch in the decoded codes" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
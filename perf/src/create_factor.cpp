@@ -0,0 +1,103 @@
+#include "factorize/create_factor.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+// Reference implementation with a std::unordered_map, as used in previous versions of create_factor().
+template<typename Input_, typename Code_>
+std::vector<Input_> reference(const std::size_t n, const Input_* const input, Code_* const codes) {
+    std::unordered_map<Input_, Code_> mapping;
+    for (std::size_t i = 0; i < n; ++i) {
+        const auto mIt = mapping.find(input[i]);
+        if (mIt != mapping.end()) {
+            codes[i] = mIt->second;
+        } else {
+            Code_ alt = mapping.size();
+            mapping[input[i]] = alt;
+            codes[i] = alt;
+        }
+    }
+
+    std::vector<std::pair<Input_, Code_> > unique(mapping.begin(), mapping.end());
+    std::sort(unique.begin(), unique.end());
+    std::vector<Code_> remapping(unique.size());
+    std::vector<Input_> output(unique.size());
+    for (std::size_t u = 0; u < unique.size(); ++u) {
+        remapping[unique[u].second] = u;
+        output[u] = unique[u].first;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        codes[i] = remapping[codes[i]];
+    }
+    return output;
+}
+
+template<class Function_>
+double time_it(Function_ fun) {
+    auto start = std::chrono::high_resolution_clock::now();
+    fun();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t n = 10000000;
+    if (argc > 1) {
+        n = std::stoull(argv[1]);
+    }
+
+    std::mt19937_64 rng(12345);
+    std::vector<int> codes(n);
+
+    for (std::size_t nuniq : { 1000, 100000, 10000000 }) {
+        // Using random 64-bit values to ensure that we don't hit the dense path for integers.
+        std::vector<std::uint64_t> pool(nuniq);
+        for (auto& p : pool) {
+            p = rng();
+        }
+        std::vector<std::uint64_t> input(n);
+        for (auto& x : input) {
+            x = pool[rng() % nuniq];
+        }
+
+        std::size_t ref_size = 0, new_size = 0;
+        const double ref_time = time_it([&]() -> void { ref_size = reference(n, input.data(), codes.data()).size(); });
+        const double new_time = time_it([&]() -> void { new_size = factorize::create_factor(n, input.data(), codes.data()).size(); });
+
+        std::cout << "uniques: " << nuniq << " (observed: " << new_size << ")" << std::endl;
+        std::cout << "  std::unordered_map: " << ref_time << " s" << std::endl;
+        std::cout << "  create_factor:      " << new_time << " s" << std::endl;
+        if (ref_size != new_size) {
+            std::cerr << "mismatch in the number of levels" << std::endl;
+            return 1;
+        }
+    }
+
+    // Comparing the hash and sort strategies on mostly-unique floating-point values.
+    {
+        std::vector<double> input(n);
+        for (auto& x : input) {
+            x = std::uniform_real_distribution<double>()(rng);
+        }
+
+        factorize::CreateFactorOptions hopt;
+        hopt.strategy = factorize::CreateFactorStrategy::HASH;
+        const double hash_time = time_it([&]() -> void { factorize::create_factor(n, input.data(), codes.data(), hopt); });
+
+        factorize::CreateFactorOptions sopt;
+        sopt.strategy = factorize::CreateFactorStrategy::SORT;
+        const double sort_time = time_it([&]() -> void { factorize::create_factor(n, input.data(), codes.data(), sopt); });
+
+        std::cout << "unique doubles" << std::endl;
+        std::cout << "  hash strategy: " << hash_time << " s" << std::endl;
+        std::cout << "  sort strategy: " << sort_time << " s" << std::endl;
+    }
+
+    return 0;
+}
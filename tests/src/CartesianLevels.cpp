@@ -0,0 +1,171 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <exception>
+
+#include "factorize/CartesianLevels.hpp"
+#include "factorize/combine_to_factor.hpp"
+
+TEST(CartesianLevels, Basic) {
+    factorize::CartesianLevels<int> levels(std::vector<int>{ 3, 2, 4 });
+    EXPECT_EQ(levels.num_variables(), 3);
+    EXPECT_EQ(levels.size(), 24);
+    EXPECT_EQ(levels.counts(), std::vector<int>({ 3, 2, 4 }));
+    EXPECT_EQ(levels.strides(), std::vector<int>({ 8, 4, 1 }));
+
+    int counter = 0;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 2; ++j) {
+            for (int k = 0; k < 4; ++k) {
+                EXPECT_EQ(levels.level(0, counter), i);
+                EXPECT_EQ(levels.level(1, counter), j);
+                EXPECT_EQ(levels.level(2, counter), k);
+                ++counter;
+            }
+        }
+    }
+
+    auto mat = levels.materialize<int>();
+    ASSERT_EQ(mat.size(), 3);
+    for (int f = 0; f < 3; ++f) {
+        ASSERT_EQ(mat[f].size(), 24);
+        for (int c = 0; c < 24; ++c) {
+            EXPECT_EQ(mat[f][c], levels.level(f, c));
+        }
+    }
+
+    factorize::CartesianLevels<int> empty;
+    EXPECT_EQ(empty.num_variables(), 0);
+    EXPECT_EQ(empty.size(), 1);
+    EXPECT_TRUE(empty.materialize<int>().empty());
+}
+
+TEST(CartesianLevels, Decode) {
+    factorize::CartesianLevels<int> levels(std::vector<int>{ 5, 7, 3 });
+
+    std::mt19937_64 rng(1000);
+    const std::size_t n = 1000;
+    std::vector<int> codes(n);
+    for (auto& c : codes) {
+        c = rng() % levels.size();
+    }
+
+    for (int threads = 1; threads <= 3; ++threads) {
+        std::vector<std::vector<unsigned char> > decoded(3, std::vector<unsigned char>(n));
+        std::vector<unsigned char*> ptrs{ decoded[0].data(), decoded[1].data(), decoded[2].data() };
+        levels.decode(n, codes.data(), ptrs, threads);
+
+        for (int f = 0; f < 3; ++f) {
+            std::vector<unsigned char> single(n);
+            levels.decode(f, n, codes.data(), single.data(), threads);
+            EXPECT_EQ(single, decoded[f]);
+            for (std::size_t i = 0; i < n; ++i) {
+                EXPECT_EQ(decoded[f][i], levels.level(f, codes[i]));
+            }
+        }
+    }
+}
+
+template<typename Code_>
+void check_decode(const std::vector<Code_>& counts, std::mt19937_64& rng) {
+    factorize::CartesianLevels<Code_> levels(counts);
+    const std::size_t nvariables = counts.size();
+    const auto& strides = levels.strides();
+
+    const std::size_t n = 10000;
+    std::vector<Code_> codes(n);
+    for (auto& c : codes) {
+        c = rng() % levels.size();
+    }
+    codes[0] = 0;
+    codes[1] = levels.size() - 1;
+
+    std::vector<std::vector<Code_> > expected(nvariables);
+    for (std::size_t f = 0; f < nvariables; ++f) {
+        for (auto c : codes) {
+            expected[f].push_back((c / strides[f]) % counts[f]);
+        }
+    }
+
+    for (int threads = 1; threads <= 3; ++threads) {
+        std::vector<std::vector<Code_> > decoded(nvariables, std::vector<Code_>(n));
+        std::vector<Code_*> ptrs;
+        for (auto& d : decoded) {
+            ptrs.push_back(d.data());
+        }
+        levels.decode(n, codes.data(), ptrs, threads);
+        EXPECT_EQ(decoded, expected);
+
+        std::vector<Code_> interleaved(n * nvariables);
+        levels.decode_interleaved(n, codes.data(), interleaved.data(), threads);
+        for (std::size_t f = 0; f < nvariables; ++f) {
+            std::vector<Code_> single(n);
+            levels.decode(f, n, codes.data(), single.data(), threads);
+            EXPECT_EQ(single, expected[f]);
+            for (std::size_t i = 0; i < n; ++i) {
+                EXPECT_EQ(interleaved[i * nvariables + f], expected[f][i]);
+            }
+        }
+    }
+}
+
+TEST(CartesianLevels, DecodeDivisors) {
+    std::mt19937_64 rng(3000);
+
+    // Mixing powers of two with divisors that need the extra bit in the magic number (e.g., 7, 641).
+    check_decode<std::uint32_t>({ 7, 641, 3, 64 }, rng);
+    check_decode<std::uint32_t>({ 1, 65535, 65537 }, rng);
+    check_decode<int>({ 100, 1000, 10000 }, rng);
+    check_decode<std::uint16_t>({ 13, 11, 17, 19 }, rng);
+    check_decode<std::uint64_t>({ 7, 641, 6700417, 1, 123456789, 3 }, rng);
+    check_decode<std::uint64_t>({ 4294967311ull, 3000000001ull }, rng);
+
+    for (std::uint64_t d = 1; d < 100; ++d) {
+        check_decode<std::uint64_t>({ 1000003, d }, rng);
+    }
+}
+
+TEST(CartesianLevels, Overflow) {
+    std::string msg;
+    try {
+        factorize::CartesianLevels<unsigned char>(std::vector<int>{ 20, 20 });
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_FALSE(msg.empty());
+}
+
+TEST(CartesianLevels, Unused) {
+    std::mt19937_64 rng(2000);
+    const std::size_t n = 500;
+    std::vector<int> first(n), second(n), third(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        first[i] = rng() % 4;
+        second[i] = rng() % 6;
+        third[i] = rng() % 3;
+    }
+    std::vector<std::pair<const int*, int> > inputs{ { first.data(), 5 }, { second.data(), 6 }, { third.data(), 3 } };
+
+    std::vector<int> ref_codes(n);
+    auto ref_levels = factorize::combine_to_factor_unused(n, inputs, ref_codes.data());
+
+    for (int threads = 1; threads <= 3; ++threads) {
+        factorize::CombineToFactorUnusedOptions opt;
+        opt.num_threads = threads;
+        std::vector<int> codes(n);
+        auto lazy = factorize::combine_to_factor_unused_lazy(n, inputs, codes.data(), opt);
+        EXPECT_EQ(codes, ref_codes);
+        EXPECT_EQ(lazy.size(), 90);
+        EXPECT_EQ(lazy.materialize<int>(threads), ref_levels);
+    }
+
+    // Handles the case with no variables.
+    std::vector<int> codes(n, 1);
+    auto lazy = factorize::combine_to_factor_unused_lazy(n, std::vector<std::pair<const int*, int> >{}, codes.data());
+    EXPECT_EQ(lazy.num_variables(), 0);
+    EXPECT_EQ(codes, std::vector<int>(n));
+}
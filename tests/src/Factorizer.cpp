@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include "factorize/Factorizer.hpp"
+#include "factorize/create_factor.hpp"
+
+TEST(Factorizer, Basic) {
+    factorize::Factorizer<std::string, int> fac;
+
+    std::vector<std::string> chunk1{ "C", "A", "C" };
+    std::vector<int> codes1(chunk1.size());
+    fac.add(chunk1.size(), chunk1.data(), codes1.data());
+    EXPECT_EQ(codes1, std::vector<int>({ 0, 1, 0 }));
+    EXPECT_EQ(fac.size(), 2);
+
+    std::vector<std::string> chunk2{ "B", "A", "D" };
+    std::vector<int> codes2(chunk2.size());
+    fac.add(chunk2.size(), chunk2.data(), codes2.data());
+    EXPECT_EQ(codes2, std::vector<int>({ 2, 1, 3 }));
+    EXPECT_EQ(fac.size(), 4);
+
+    auto res = fac.finish();
+    std::vector<std::string> expected{ "A", "B", "C", "D" };
+    EXPECT_EQ(res.levels, expected);
+    std::vector<int> remapping{ 2, 0, 1, 3 };
+    EXPECT_EQ(res.remapping, remapping);
+}
+
+TEST(Factorizer, Empty) {
+    factorize::Factorizer<int, int> fac;
+    auto res = fac.finish();
+    EXPECT_TRUE(res.levels.empty());
+    EXPECT_TRUE(res.remapping.empty());
+}
+
+TEST(Factorizer, Simulated) {
+    std::mt19937_64 rng(42);
+    std::vector<int> stuff(1000);
+    for (auto& s : stuff) {
+        s = static_cast<int>(rng() % 500) * 13 - 2000;
+    }
+
+    std::vector<int> ref_codes(stuff.size());
+    auto ref_levels = factorize::create_factor(stuff.size(), stuff.data(), ref_codes.data());
+
+    factorize::Factorizer<int, int> fac(10);
+    std::vector<int> codes(stuff.size());
+    for (std::size_t start = 0; start < stuff.size(); start += 77) {
+        const auto len = std::min(stuff.size() - start, static_cast<std::size_t>(77));
+        fac.add(len, stuff.data() + start, codes.data() + start);
+    }
+
+    auto res = fac.finish();
+    EXPECT_EQ(res.levels, ref_levels);
+    for (auto& c : codes) {
+        c = res.remapping[c];
+    }
+    EXPECT_EQ(codes, ref_codes);
+}
+
+TEST(Factorizer, FullCodeRange) {
+    std::vector<int> values;
+    for (int i = 0; i < 256; ++i) {
+        values.push_back(i * 1000);
+    }
+
+    factorize::Factorizer<int, unsigned char> fac;
+    std::vector<unsigned char> codes(values.size());
+    fac.add(values.size(), values.data(), codes.data());
+    fac.add(values.size(), values.data(), codes.data());
+    EXPECT_EQ(fac.size(), 256);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(codes[i], i);
+    }
+}
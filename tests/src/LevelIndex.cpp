@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstddef>
+
+#include "factorize/LevelIndex.hpp"
+#include "factorize/create_factor.hpp"
+
+TEST(LevelIndex, Direct) {
+    std::vector<int> levels{ -3, 0, 2, 5 };
+    factorize::LevelIndex<int, int> index(levels);
+    EXPECT_EQ(index.size(), 4);
+
+    std::vector<int> input{ 5, -3, -4, 2, 6, 1, 0 };
+    std::vector<int> codes(input.size());
+    index.encode(input.size(), input.data(), codes.data(), -1);
+    std::vector<int> expected{ 3, 0, -1, 2, -1, -1, 1 };
+    EXPECT_EQ(codes, expected);
+
+    factorize::LevelIndex<int, int> empty(std::vector<int>{});
+    EXPECT_EQ(empty.find(1, -1), -1);
+}
+
+TEST(LevelIndex, Search) {
+    std::vector<std::string> levels{ "A", "B", "D", "E", "F", "H", "X" };
+    factorize::LevelIndex<std::string, int> index(levels);
+    for (std::size_t l = 0; l < levels.size(); ++l) {
+        EXPECT_EQ(index.find(levels[l], -1), l);
+    }
+    EXPECT_EQ(index.find("", -1), -1);
+    EXPECT_EQ(index.find("C", -1), -1);
+    EXPECT_EQ(index.find("G", -1), -1);
+    EXPECT_EQ(index.find("Z", -1), -1);
+
+    std::vector<double> dlevels{ -1.5, 0, 2.5 };
+    factorize::LevelIndex<double, int> dindex(dlevels);
+    EXPECT_EQ(dindex.find(-1.5, -1), 0);
+    EXPECT_EQ(dindex.find(-0.0, -1), 1);
+    EXPECT_EQ(dindex.find(2.5, -1), 2);
+    EXPECT_EQ(dindex.find(3, -1), -1);
+}
+
+TEST(LevelIndex, Simulated) {
+    std::mt19937_64 rng(42);
+    for (int scale : { 1, 1000000 }) { // small and large ranges, to test both the direct and search paths.
+        std::vector<long long> reference(1000);
+        for (auto& r : reference) {
+            r = static_cast<long long>(rng() % 200) * scale;
+        }
+        std::vector<int> ref_codes(reference.size());
+        auto levels = factorize::create_factor(reference.size(), reference.data(), ref_codes.data());
+
+        factorize::LevelIndex<long long, int> index(levels);
+        std::vector<int> codes(reference.size());
+        index.encode(reference.size(), reference.data(), codes.data(), -1, 3);
+        EXPECT_EQ(codes, ref_codes);
+
+        std::vector<long long> other(1000);
+        for (auto& o : other) {
+            o = static_cast<long long>(rng() % 400) * scale - 100 * scale;
+        }
+        index.encode(other.size(), other.data(), codes.data(), -1);
+        for (std::size_t i = 0; i < other.size(); ++i) {
+            auto it = std::lower_bound(levels.begin(), levels.end(), other[i]);
+            if (it != levels.end() && *it == other[i]) {
+                EXPECT_EQ(codes[i], it - levels.begin());
+            } else {
+                EXPECT_EQ(codes[i], -1);
+            }
+        }
+    }
+}
+
+TEST(LevelIndex, Batched) {
+    // Checking that the interleaved searches are the same as the scalar searches for trees of different shapes.
+    std::mt19937_64 rng(43);
+    for (std::size_t nlevels = 0; nlevels <= 70; ++nlevels) {
+        std::vector<std::string> levels;
+        for (std::size_t l = 0; l < nlevels; ++l) {
+            levels.push_back(std::to_string(l * 2 + 1000));
+        }
+        std::sort(levels.begin(), levels.end());
+        factorize::LevelIndex<std::string, int> index(levels);
+
+        std::vector<std::string> input(rng() % 100 + 1);
+        for (auto& x : input) {
+            x = std::to_string(rng() % (nlevels * 2 + 10) + 995);
+        }
+        std::vector<int> expected(input.size());
+        for (std::size_t i = 0; i < input.size(); ++i) {
+            expected[i] = index.find(input[i], -1);
+        }
+
+        for (int threads = 1; threads <= 3; ++threads) {
+            std::vector<int> codes(input.size());
+            index.encode(input.size(), input.data(), codes.data(), -1, threads);
+            EXPECT_EQ(codes, expected);
+        }
+    }
+}
+
+TEST(LevelIndex, FullCodeRange) {
+    // Using every value of the code type, so the missing marker in the lookup table must not wrap around to a valid code.
+    std::vector<int> levels;
+    for (int i = 0; i < 256; ++i) {
+        levels.push_back(i * 2);
+    }
+    factorize::LevelIndex<int, unsigned char> index(levels);
+    for (int i = 0; i < 256; ++i) {
+        EXPECT_EQ(index.find(i * 2, 0), i);
+        EXPECT_EQ(index.find(i * 2 + 1, 200), 200);
+    }
+    EXPECT_EQ(index.find(-1, 200), 200);
+}
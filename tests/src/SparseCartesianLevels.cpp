@@ -0,0 +1,128 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <exception>
+
+#include "factorize/SparseCartesianLevels.hpp"
+#include "factorize/combine_to_factor.hpp"
+
+TEST(SparseCartesianLevels, Basic) {
+    factorize::CartesianLevels<std::uint64_t> space(std::vector<int>{ 3, 2, 4 });
+    factorize::SparseCartesianLevels<int> levels(space, std::vector<std::uint64_t>{ 1, 5, 6, 23 });
+    EXPECT_EQ(levels.num_variables(), 3);
+    EXPECT_EQ(levels.size(), 4);
+    EXPECT_EQ(levels.space().size(), 24);
+    EXPECT_EQ(levels.key(2), 6);
+
+    EXPECT_EQ(levels.find(5, -1), 1);
+    EXPECT_EQ(levels.find(23, -1), 3);
+    EXPECT_EQ(levels.find(0, -1), -1);
+    EXPECT_EQ(levels.find(7, -1), -1);
+    EXPECT_EQ(levels.find(24, -1), -1);
+
+    auto mat = levels.materialize<int>();
+    std::vector<std::vector<int> > expected{ { 0, 0, 0, 2 }, { 0, 1, 1, 1 }, { 1, 1, 2, 3 } };
+    EXPECT_EQ(mat, expected);
+    for (int f = 0; f < 3; ++f) {
+        for (int c = 0; c < 4; ++c) {
+            EXPECT_EQ(levels.level(f, c), expected[f][c]);
+        }
+    }
+
+    std::vector<int> codes{ 3, 0, 2, 2, 1 };
+    std::vector<std::vector<int> > decoded(3, std::vector<int>(codes.size()));
+    levels.decode(codes.size(), codes.data(), std::vector<int*>{ decoded[0].data(), decoded[1].data(), decoded[2].data() });
+    for (int f = 0; f < 3; ++f) {
+        std::vector<int> single(codes.size());
+        levels.decode(f, codes.size(), codes.data(), single.data());
+        EXPECT_EQ(single, decoded[f]);
+        for (std::size_t i = 0; i < codes.size(); ++i) {
+            EXPECT_EQ(decoded[f][i], expected[f][codes[i]]);
+        }
+    }
+}
+
+TEST(SparseCartesianLevels, Unused) {
+    std::mt19937_64 rng(4000);
+    const std::size_t n = 1000;
+    std::vector<int> first(n), second(n), third(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        first[i] = rng() % 4;
+        second[i] = rng() % 6;
+        third[i] = rng() % 3;
+    }
+    std::vector<std::pair<const int*, int> > inputs{ { first.data(), 5 }, { second.data(), 6 }, { third.data(), 3 } };
+
+    // Comparing to the observed subset of the full product.
+    std::vector<int> ref_codes(n);
+    auto ref_levels = factorize::combine_to_factor_unused(n, inputs, ref_codes.data());
+    std::vector<int> obs_codes(n);
+    auto observed = factorize::create_factor(n, ref_codes.data(), obs_codes.data());
+
+    for (int threads = 1; threads <= 3; ++threads) {
+        factorize::CombineToFactorUnusedOptions opt;
+        opt.num_threads = threads;
+        std::vector<int> codes(n);
+        auto sparse = factorize::combine_to_factor_unused_sparse(n, inputs, codes.data(), opt);
+        EXPECT_EQ(codes, obs_codes);
+        EXPECT_EQ(sparse.keys(), std::vector<std::uint64_t>(observed.begin(), observed.end()));
+
+        auto mat = sparse.materialize<int>(threads);
+        ASSERT_EQ(mat.size(), 3);
+        for (int f = 0; f < 3; ++f) {
+            for (std::size_t c = 0; c < observed.size(); ++c) {
+                EXPECT_EQ(mat[f][c], ref_levels[f][observed[c]]);
+            }
+        }
+    }
+}
+
+TEST(SparseCartesianLevels, Overflow) {
+    // Full product is far too large for 16-bit codes, but the number of observed combinations is small.
+    std::mt19937_64 rng(5000);
+    const std::size_t n = 2000;
+    const int nvariables = 6, nlevels = 1000;
+    std::vector<std::vector<int> > contents(nvariables, std::vector<int>(n));
+    std::vector<std::pair<const int*, int> > inputs;
+    for (auto& con : contents) {
+        for (auto& x : con) {
+            x = (rng() % 5) * 199;
+        }
+        inputs.emplace_back(con.data(), nlevels);
+    }
+
+    std::string msg;
+    try {
+        std::vector<std::uint16_t> codes(n);
+        factorize::combine_to_factor_unused(n, inputs, codes.data());
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_FALSE(msg.empty());
+
+    std::vector<std::uint16_t> codes(n);
+    auto sparse = factorize::combine_to_factor_unused_sparse(n, inputs, codes.data());
+    EXPECT_EQ(sparse.space().size(), 1000000000000000000ull);
+
+    std::vector<const int*> ptrs;
+    for (const auto& con : contents) {
+        ptrs.push_back(con.data());
+    }
+    std::vector<int> ref_codes(n);
+    auto ref_levels = factorize::combine_to_factor(n, ptrs, ref_codes.data());
+    EXPECT_EQ(std::vector<int>(codes.begin(), codes.end()), ref_codes);
+    EXPECT_EQ(sparse.materialize<int>(), ref_levels);
+
+    // Respects the Cartesian ordering.
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint64_t expected = 0;
+        for (int f = 0; f < nvariables; ++f) {
+            expected = expected * nlevels + contents[f][i];
+        }
+        EXPECT_EQ(sparse.key(codes[i]), expected);
+    }
+}
@@ -1,14 +1,22 @@
 #include "gtest/gtest.h"
 
 #include <random>
+#include <algorithm>
 #include <vector>
+#include <string>
+#include <map>
+#include <tuple>
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <exception>
 
 #include "factorize/combine_to_factor.hpp"
 
 template<typename Factor_>
-std::pair<std::vector<std::vector<Factor_> >, std::vector<int> > test_combine_factors(std::size_t n, const std::vector<const Factor_*>& factors) {
+std::pair<std::vector<std::vector<Factor_> >, std::vector<int> > test_combine_factors(std::size_t n, const std::vector<const Factor_*>& factors, const factorize::CombineToFactorOptions& options = factorize::CombineToFactorOptions()) {
     std::vector<int> combined(n, -1); // make sure that default value is actually overwritten.
-    auto levels = factorize::combine_to_factor(n, factors, combined.data());
+    auto levels = factorize::combine_to_factor(n, factors, combined.data(), options);
     return std::make_pair(std::move(levels), std::move(combined));
 }
 
@@ -223,3 +231,933 @@ TEST(CombineFactorsUnused, Multiple) {
         EXPECT_EQ(combined.first[2], create_mock_sequence(4, 1, 6));
     }
 }
+
+TEST(CombineFactorsUnused, Parallel) {
+    std::mt19937_64 rng(8000);
+    const std::size_t n = 10001;
+    std::vector<int> counts{ 3, 7, 5, 2 };
+    std::vector<std::vector<int> > contents(counts.size(), std::vector<int>(n));
+    std::vector<std::pair<const int*, int> > inputs;
+    for (std::size_t f = 0; f < counts.size(); ++f) {
+        for (auto& x : contents[f]) {
+            x = rng() % counts[f];
+        }
+        inputs.emplace_back(contents[f].data(), counts[f]);
+    }
+
+    std::vector<int> ref_codes(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        int current = 0;
+        for (std::size_t f = 0; f < counts.size(); ++f) {
+            current = current * counts[f] + contents[f][i];
+        }
+        ref_codes[i] = current;
+    }
+    auto ref = test_combine_factors_unused(n, inputs);
+    EXPECT_EQ(ref.second, ref_codes);
+    EXPECT_EQ(ref.first[0].size(), 210);
+    for (int c = 0; c < 210; ++c) {
+        int current = 0;
+        for (std::size_t f = 0; f < counts.size(); ++f) {
+            current = current * counts[f] + ref.first[f][c];
+        }
+        EXPECT_EQ(current, c);
+    }
+
+    for (int nthreads : { 2, 3, 7 }) {
+        factorize::CombineToFactorUnusedOptions opt;
+        opt.num_threads = nthreads;
+        std::vector<int> codes(n, -1);
+        auto levels = factorize::combine_to_factor_unused(n, inputs, codes.data(), opt);
+        EXPECT_EQ(codes, ref_codes);
+        EXPECT_EQ(levels, ref.first);
+    }
+}
+
+TEST(CrossTabulate, Basic) {
+    std::mt19937_64 rng(11000);
+    const std::size_t n = 5000;
+    std::vector<int> stuff1(n), stuff2(n), stuff3(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        stuff1[i] = rng() % 5;
+        stuff2[i] = rng() % 7;
+        stuff3[i] = rng() % 11;
+    }
+
+    for (int nlevels : { 11, 100, 200 }) { // small and large number of possible combinations.
+        std::vector<std::pair<const int*, int> > inputs{ { stuff1.data(), 6 }, { stuff2.data(), 7 }, { stuff3.data(), nlevels } };
+        std::vector<int> ref_codes(n);
+        auto ref_levels = factorize::combine_to_factor_unused(n, inputs, ref_codes.data());
+        std::vector<std::size_t> ref_counts(ref_levels.front().size());
+        for (auto c : ref_codes) {
+            ++ref_counts[c];
+        }
+
+        for (int threads = 1; threads <= 3; ++threads) {
+            factorize::CrossTabulateOptions opt;
+            opt.num_threads = threads;
+            std::vector<int> codes(n);
+            auto tab = factorize::cross_tabulate(n, inputs, codes.data(), opt);
+            EXPECT_EQ(codes, ref_codes);
+            EXPECT_EQ(tab.levels.size(), ref_counts.size());
+            EXPECT_EQ(tab.sparse, nlevels > 100); // for 100, the dense table is shared across threads as it is too large to replicate.
+            EXPECT_FALSE(tab.overflow);
+
+            if (tab.sparse) {
+                EXPECT_EQ(tab.combinations.size(), tab.counts.size());
+                EXPECT_TRUE(std::is_sorted(tab.combinations.begin(), tab.combinations.end()));
+                std::vector<std::size_t> densified(ref_counts.size());
+                for (std::size_t c = 0; c < tab.combinations.size(); ++c) {
+                    EXPECT_GT(tab.counts[c], 0);
+                    densified[tab.combinations[c]] = tab.counts[c];
+                }
+                EXPECT_EQ(densified, ref_counts);
+            } else {
+                EXPECT_TRUE(tab.combinations.empty());
+                EXPECT_EQ(tab.counts, ref_counts);
+            }
+        }
+
+        // Forcing a dense table.
+        factorize::CrossTabulateOptions dopt;
+        dopt.max_dense_ratio = 1000;
+        std::vector<int> codes(n);
+        auto tab = factorize::cross_tabulate(n, inputs, codes.data(), dopt);
+        EXPECT_FALSE(tab.sparse);
+        EXPECT_EQ(tab.counts, ref_counts);
+    }
+
+    // No variables.
+    std::vector<int> codes(n, 1);
+    auto tab = factorize::cross_tabulate(n, std::vector<std::pair<const int*, int> >{}, codes.data());
+    EXPECT_EQ(codes, std::vector<int>(n));
+    EXPECT_FALSE(tab.sparse);
+    EXPECT_EQ(tab.counts, std::vector<std::size_t>{ n });
+}
+
+TEST(CrossTabulate, Overflow) {
+    // Full product is far too large for 16-bit codes, but the number of observed combinations is small.
+    std::mt19937_64 rng(11500);
+    const std::size_t n = 10000;
+    const int nvariables = 6, nlevels = 1000;
+    std::vector<std::vector<int> > contents(nvariables, std::vector<int>(n));
+    std::vector<std::pair<const int*, int> > inputs;
+    for (auto& con : contents) {
+        for (auto& x : con) {
+            x = (rng() % 3) * 199;
+        }
+        inputs.emplace_back(con.data(), nlevels);
+    }
+
+    std::vector<std::uint16_t> ref_codes(n);
+    auto ref = factorize::combine_to_factor_unused_sparse(n, inputs, ref_codes.data());
+    std::vector<std::size_t> ref_counts(ref.size());
+    for (auto c : ref_codes) {
+        ++ref_counts[c];
+    }
+
+    for (int threads = 1; threads <= 3; ++threads) {
+        factorize::CrossTabulateOptions opt;
+        opt.num_threads = threads;
+        opt.max_dense_ratio = 1000; // ignored as the product overflows.
+        std::vector<std::uint16_t> codes(n);
+        auto tab = factorize::cross_tabulate(n, inputs, codes.data(), opt);
+        EXPECT_TRUE(tab.sparse);
+        EXPECT_TRUE(tab.overflow);
+        EXPECT_TRUE(tab.combinations.empty());
+        EXPECT_EQ(codes, ref_codes);
+        EXPECT_EQ(tab.observed.keys(), ref.keys());
+        EXPECT_EQ(tab.counts, ref_counts);
+    }
+
+    // Too many observed combinations for the code type.
+    std::string msg;
+    try {
+        std::vector<unsigned char> codes(n);
+        factorize::cross_tabulate(n, inputs, codes.data());
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_FALSE(msg.empty());
+}
+
+TEST(CombineFactorsUnsorted, Basic) {
+    std::vector<int> stuff1{ 2, 0, 2, 1, 0, 2 };
+    std::vector<std::string> stuff2{ "B", "A", "B", "A", "A", "A" };
+
+    {
+        std::vector<int> codes(stuff1.size(), -1);
+        auto levels = factorize::combine_to_factor_unsorted(stuff1.size(), std::vector<const int*>{ stuff1.data() }, codes.data());
+        EXPECT_EQ(levels.size(), 1);
+        EXPECT_EQ(levels[0], std::vector<int>({ 2, 0, 1 }));
+        EXPECT_EQ(codes, std::vector<int>({ 0, 1, 0, 2, 1, 0 }));
+
+        std::vector<int> empty_codes(10, -1);
+        auto empty_levels = factorize::combine_to_factor_unsorted(empty_codes.size(), std::vector<const int*>{}, empty_codes.data());
+        EXPECT_TRUE(empty_levels.empty());
+        EXPECT_EQ(empty_codes, std::vector<int>(10));
+    }
+
+    std::vector<std::string> stuff1s;
+    for (auto s : stuff1) {
+        stuff1s.push_back(std::to_string(s));
+    }
+    std::vector<int> codes(stuff1.size(), -1);
+    auto levels = factorize::combine_to_factor_unsorted(stuff1.size(), std::vector<const std::string*>{ stuff1s.data(), stuff2.data() }, codes.data());
+    EXPECT_EQ(codes, std::vector<int>({ 0, 1, 0, 2, 1, 3 }));
+    EXPECT_EQ(levels[0], std::vector<std::string>({ "2", "0", "1", "2" }));
+    EXPECT_EQ(levels[1], std::vector<std::string>({ "B", "A", "A", "A" }));
+
+    auto remap = factorize::sort_combined_levels<int>(levels);
+    EXPECT_EQ(levels[0], std::vector<std::string>({ "0", "1", "2", "2" }));
+    EXPECT_EQ(levels[1], std::vector<std::string>({ "A", "A", "A", "B" }));
+    for (auto& c : codes) {
+        c = remap[c];
+    }
+
+    std::vector<int> ref_codes(stuff1.size());
+    auto ref_levels = factorize::combine_to_factor(stuff1.size(), std::vector<const std::string*>{ stuff1s.data(), stuff2.data() }, ref_codes.data());
+    EXPECT_EQ(ref_codes, codes);
+    EXPECT_EQ(ref_levels, levels);
+}
+
+TEST(CombineFactors, Summary) {
+    std::vector<int> stuff1{ 2, 0, 2, 1, 0, 2, 1 };
+    std::vector<std::string> stuff2{ "B", "A", "B", "A", "A", "A", "A" };
+
+    std::vector<int> codes(stuff1.size(), -1);
+    factorize::FactorSummary summary;
+    std::vector<std::string> stuff1s;
+    for (auto s : stuff1) {
+        stuff1s.push_back(std::to_string(s));
+    }
+    auto levels = factorize::combine_to_factor(stuff1.size(), std::vector<const std::string*>{ stuff1s.data(), stuff2.data() }, codes.data(), factorize::CombineToFactorOptions(), summary);
+    EXPECT_EQ(codes, std::vector<int>({ 3, 0, 3, 1, 0, 2, 1 }));
+    EXPECT_EQ(summary.counts, std::vector<std::size_t>({ 2, 2, 1, 2 }));
+    EXPECT_EQ(summary.first, std::vector<std::size_t>({ 1, 3, 5, 0 }));
+    EXPECT_EQ(summary.last, std::vector<std::size_t>({ 4, 6, 5, 2 }));
+
+    // Single factor.
+    factorize::combine_to_factor(stuff1.size(), std::vector<const int*>{ stuff1.data() }, codes.data(), factorize::CombineToFactorOptions(), summary);
+    EXPECT_EQ(summary.counts, std::vector<std::size_t>({ 2, 2, 3 }));
+    EXPECT_EQ(summary.first, std::vector<std::size_t>({ 1, 3, 0 }));
+    EXPECT_EQ(summary.last, std::vector<std::size_t>({ 4, 6, 5 }));
+
+    // No factors.
+    factorize::combine_to_factor(stuff1.size(), std::vector<const int*>{}, codes.data(), factorize::CombineToFactorOptions(), summary);
+    EXPECT_EQ(summary.counts, std::vector<std::size_t>({ 7 }));
+    EXPECT_EQ(summary.first, std::vector<std::size_t>({ 0 }));
+    EXPECT_EQ(summary.last, std::vector<std::size_t>({ 6 }));
+}
+
+template<typename Factor_>
+void compare_combine_factors_to_reference(std::size_t n, const std::vector<const Factor_*>& factors, const factorize::CombineToFactorOptions& options = factorize::CombineToFactorOptions()) {
+    std::map<std::vector<Factor_>, std::vector<std::size_t> > collected;
+    for (std::size_t i = 0; i < n; ++i) {
+        std::vector<Factor_> current;
+        for (auto f : factors) {
+            current.push_back(f[i]);
+        }
+        collected[current].push_back(i);
+    }
+
+    std::vector<int> expected(n);
+    std::vector<std::vector<Factor_> > levels(factors.size());
+    int counter = 0;
+    for (const auto& p : collected) {
+        for (std::size_t f = 0; f < factors.size(); ++f) {
+            levels[f].push_back(p.first[f]);
+        }
+        for (auto i : p.second) {
+            expected[i] = counter;
+        }
+        ++counter;
+    }
+
+    auto combined = test_combine_factors(n, factors, options);
+    EXPECT_EQ(combined.first, levels);
+    EXPECT_EQ(combined.second, expected);
+
+    std::vector<std::size_t> counts, first, last;
+    for (const auto& p : collected) {
+        counts.push_back(p.second.size());
+        first.push_back(p.second.front());
+        last.push_back(p.second.back());
+    }
+    std::vector<int> codes(n);
+    factorize::FactorSummary summary;
+    factorize::combine_to_factor(n, factors, codes.data(), options, summary);
+    EXPECT_EQ(codes, expected);
+    EXPECT_EQ(summary.counts, counts);
+    EXPECT_EQ(summary.first, first);
+    EXPECT_EQ(summary.last, last);
+}
+
+TEST(CombineFactors, ManyVariables) {
+    std::mt19937_64 rng(2000);
+    const std::size_t n = 5000;
+
+    // Enough levels per variable to overflow the 64-bit mixed-radix keys, forcing compaction.
+    for (std::size_t nvars : { 3, 8, 15 }) {
+        std::vector<std::vector<int> > contents(nvars, std::vector<int>(n));
+        std::vector<const int*> ptrs;
+        for (auto& con : contents) {
+            for (auto& x : con) {
+                x = static_cast<int>(rng() % 400) * 1000 - 200000;
+            }
+            ptrs.push_back(con.data());
+        }
+        compare_combine_factors_to_reference(n, ptrs);
+    }
+
+    // Mixing in some low-cardinality variables and strings.
+    {
+        std::vector<std::vector<std::string> > contents(4, std::vector<std::string>(n));
+        std::vector<const std::string*> ptrs;
+        for (std::size_t v = 0; v < contents.size(); ++v) {
+            for (auto& x : contents[v]) {
+                x = std::to_string(rng() % (v * 10 + 2));
+            }
+            ptrs.push_back(contents[v].data());
+        }
+        compare_combine_factors_to_reference(n, ptrs);
+    }
+
+    // Empty.
+    {
+        std::vector<int> empty;
+        auto combined = test_combine_factors(0, std::vector<const int*>{ empty.data(), empty.data() });
+        EXPECT_EQ(combined.first.size(), 2);
+        EXPECT_TRUE(combined.first[0].empty());
+        EXPECT_TRUE(combined.first[1].empty());
+    }
+}
+
+struct NonHashable {
+    NonHashable() = default;
+    NonHashable(int x) : value(x) {}
+    int value = 0;
+    bool operator<(const NonHashable& other) const { return value < other.value; }
+    bool operator>(const NonHashable& other) const { return value > other.value; }
+    bool operator!=(const NonHashable& other) const { return value != other.value; }
+    bool operator==(const NonHashable& other) const { return value == other.value; }
+};
+
+TEST(CombineFactors, NonHashable) {
+    std::vector<NonHashable> stuff1{ 2, 0, 2, 1, 0, 2 };
+    std::vector<NonHashable> stuff2{ 5, 3, 5, 3, 4, 3 };
+    compare_combine_factors_to_reference(stuff1.size(), std::vector<const NonHashable*>{ stuff1.data(), stuff2.data() });
+}
+
+TEST(CombineFactorsUnsorted, Parallel) {
+    std::mt19937_64 rng(12000);
+    const std::size_t n = 5000;
+    std::vector<int> stuff1(n), stuff2(n), stuff3(n);
+    std::vector<NonHashable> nh1(n), nh2(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        stuff1[i] = static_cast<int>(rng() % 20) * 997;
+        stuff2[i] = rng() % 7;
+        stuff3[i] = static_cast<int>(rng() % 30) - 15;
+        nh1[i] = stuff1[i];
+        nh2[i] = stuff2[i];
+    }
+    std::vector<const int*> ptrs{ stuff1.data(), stuff2.data(), stuff3.data() };
+
+    // Reference from the non-hashable fallback, which uses a std::map.
+    std::vector<int> ref_codes(n);
+    auto ref_levels = factorize::combine_to_factor_unsorted(n, std::vector<const NonHashable*>{ nh1.data(), nh2.data() }, ref_codes.data());
+    std::vector<int> two_codes(n);
+    auto two_levels = factorize::combine_to_factor_unsorted(n, std::vector<const int*>{ stuff1.data(), stuff2.data() }, two_codes.data());
+    EXPECT_EQ(two_codes, ref_codes);
+    ASSERT_EQ(two_levels.size(), 2);
+    for (std::size_t f = 0; f < 2; ++f) {
+        EXPECT_EQ(std::vector<NonHashable>(two_levels[f].begin(), two_levels[f].end()), ref_levels[f]);
+    }
+
+    std::vector<int> single_codes(n);
+    auto single_levels = factorize::combine_to_factor_unsorted(n, ptrs, single_codes.data());
+    int next = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const auto c = single_codes[i];
+        EXPECT_LE(c, next); // levels are ordered by their first appearance.
+        if (c == next) {
+            ++next;
+        }
+        for (std::size_t f = 0; f < ptrs.size(); ++f) {
+            EXPECT_EQ(single_levels[f][c], ptrs[f][i]);
+        }
+    }
+
+    for (int threads = 2; threads <= 7; ++threads) {
+        factorize::CombineToFactorOptions opt;
+        opt.num_threads = threads;
+        std::vector<int> codes(n);
+        auto levels = factorize::combine_to_factor_unsorted(n, ptrs, codes.data(), opt);
+        EXPECT_EQ(codes, single_codes);
+        EXPECT_EQ(levels, single_levels);
+    }
+}
+
+TEST(CombineFactors, Dense) {
+    std::mt19937_64 rng(3000);
+    const std::size_t n = 10000;
+
+    // Small ranges with negative values, where not all combinations are observed.
+    {
+        std::vector<int> stuff1(n), stuff2(n), stuff3(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = static_cast<int>(rng() % 20) - 10;
+            stuff2[i] = static_cast<int>(rng() % 15) * 2;
+            stuff3[i] = (stuff1[i] + stuff2[i]) % 3; // creating some structure so that the combinations are sparse.
+        }
+        compare_combine_factors_to_reference(n, std::vector<const int*>{ stuff1.data(), stuff2.data(), stuff3.data() });
+
+        std::vector<int> codes(n);
+        factorize::FactorSummary summary;
+        auto levels = factorize::combine_to_factor(n, std::vector<const int*>{ stuff1.data(), stuff2.data(), stuff3.data() }, codes.data(), factorize::CombineToFactorOptions(), summary);
+        const auto nlevels = levels.front().size();
+        EXPECT_EQ(summary.counts.size(), nlevels);
+        std::vector<std::size_t> counts(nlevels);
+        for (auto c : codes) {
+            ++counts[c];
+        }
+        EXPECT_EQ(counts, summary.counts);
+    }
+
+    // Product of ranges is just above the number of observations.
+    {
+        std::vector<unsigned char> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = rng() % 101;
+            stuff2[i] = rng() % 100;
+        }
+        compare_combine_factors_to_reference(n, std::vector<const unsigned char*>{ stuff1.data(), stuff2.data() });
+    }
+}
+
+TEST(CombineFactors, SortStrategy) {
+    std::mt19937_64 rng(4000);
+    const std::size_t n = 3000;
+    factorize::CombineToFactorOptions opt;
+    opt.strategy = factorize::CombineToFactorStrategy::SORT;
+
+    // Radix-sortable types.
+    {
+        std::vector<std::vector<int> > contents(4, std::vector<int>(n));
+        std::vector<const int*> ptrs;
+        for (auto& con : contents) {
+            for (auto& x : con) {
+                x = static_cast<int>(rng() % 5) * 100000 - 200000;
+            }
+            ptrs.push_back(con.data());
+        }
+        compare_combine_factors_to_reference(n, ptrs, opt);
+        compare_combine_factors_to_reference(n, std::vector<const int*>{ ptrs.front() }, opt);
+    }
+
+    {
+        std::vector<double> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = static_cast<double>(rng() % 20) / 3 - 2;
+            stuff2[i] = static_cast<double>(rng() % 1000) / 7;
+        }
+        compare_combine_factors_to_reference(n, std::vector<const double*>{ stuff1.data(), stuff2.data() }, opt);
+    }
+
+    // Comparison-based sort.
+    {
+        std::vector<std::string> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = std::to_string(rng() % 50);
+            stuff2[i] = std::to_string(rng() % 10);
+        }
+        compare_combine_factors_to_reference(n, std::vector<const std::string*>{ stuff1.data(), stuff2.data() }, opt);
+    }
+
+    {
+        std::vector<NonHashable> stuff1{ 2, 0, 2, 1, 0, 2 };
+        std::vector<NonHashable> stuff2{ 5, 3, 5, 3, 4, 3 };
+        compare_combine_factors_to_reference(stuff1.size(), std::vector<const NonHashable*>{ stuff1.data(), stuff2.data() }, opt);
+    }
+
+    // Empty.
+    {
+        std::vector<double> empty;
+        auto combined = test_combine_factors(0, std::vector<const double*>{ empty.data(), empty.data() }, opt);
+        EXPECT_EQ(combined.first.size(), 2);
+        EXPECT_TRUE(combined.first[0].empty());
+    }
+}
+
+TEST(CombineFactors, HashStrategy) {
+    std::mt19937_64 rng(5000);
+    const std::size_t n = 10000; // more than one block of observations.
+    factorize::CombineToFactorOptions opt;
+    opt.strategy = factorize::CombineToFactorStrategy::HASH;
+
+    for (int nlevels : { 3, 50 }) {
+        std::vector<std::vector<int> > contents(5, std::vector<int>(n));
+        std::vector<const int*> ptrs;
+        for (auto& con : contents) {
+            for (auto& x : con) {
+                x = static_cast<int>(rng() % nlevels) * 100000;
+            }
+            ptrs.push_back(con.data());
+        }
+        compare_combine_factors_to_reference(n, ptrs, opt);
+        compare_combine_factors_to_reference(n, std::vector<const int*>{ ptrs.front() }, opt);
+    }
+
+    {
+        std::vector<std::string> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = std::to_string(rng() % 50);
+            stuff2[i] = std::to_string(rng() % 10);
+        }
+        compare_combine_factors_to_reference(n, std::vector<const std::string*>{ stuff1.data(), stuff2.data() }, opt);
+    }
+
+    // Falls back for non-hashable types.
+    {
+        std::vector<NonHashable> stuff1{ 2, 0, 2, 1, 0, 2 };
+        std::vector<NonHashable> stuff2{ 5, 3, 5, 3, 4, 3 };
+        compare_combine_factors_to_reference(stuff1.size(), std::vector<const NonHashable*>{ stuff1.data(), stuff2.data() }, opt);
+    }
+
+    // Empty.
+    {
+        std::vector<std::string> empty;
+        auto combined = test_combine_factors(0, std::vector<const std::string*>{ empty.data(), empty.data() }, opt);
+        EXPECT_EQ(combined.first.size(), 2);
+        EXPECT_TRUE(combined.first[0].empty());
+    }
+}
+
+TEST(CombineFactors, Heterogeneous) {
+    std::mt19937_64 rng(6000);
+    const std::size_t n = 2000;
+    std::vector<std::string> samples(n);
+    std::vector<int> clusters(n);
+    std::vector<double> doses(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        samples[i] = "sample" + std::to_string(rng() % 10);
+        clusters[i] = static_cast<int>(rng() % 30) * 1000;
+        doses[i] = static_cast<double>(rng() % 4) / 2;
+    }
+
+    std::map<std::tuple<std::string, int, double>, std::vector<std::size_t> > collected;
+    for (std::size_t i = 0; i < n; ++i) {
+        collected[std::make_tuple(samples[i], clusters[i], doses[i])].push_back(i);
+    }
+    std::vector<int> expected(n);
+    std::vector<std::string> expected_samples;
+    std::vector<int> expected_clusters;
+    std::vector<double> expected_doses;
+    int counter = 0;
+    for (const auto& p : collected) {
+        expected_samples.push_back(std::get<0>(p.first));
+        expected_clusters.push_back(std::get<1>(p.first));
+        expected_doses.push_back(std::get<2>(p.first));
+        for (auto i : p.second) {
+            expected[i] = counter;
+        }
+        ++counter;
+    }
+
+    std::vector<int> codes(n, -1);
+    auto levels = factorize::combine_to_factor(n, std::make_tuple(static_cast<const std::string*>(samples.data()), static_cast<const int*>(clusters.data()), static_cast<const double*>(doses.data())), codes.data());
+    EXPECT_EQ(codes, expected);
+    EXPECT_EQ(std::get<0>(levels), expected_samples);
+    EXPECT_EQ(std::get<1>(levels), expected_clusters);
+    EXPECT_EQ(std::get<2>(levels), expected_doses);
+
+    // Consistent with the homogeneous version.
+    std::vector<int> ref_codes(n);
+    auto ref = factorize::combine_to_factor(n, std::vector<const int*>{ clusters.data(), clusters.data() }, ref_codes.data());
+    auto alt = factorize::combine_to_factor(n, std::tuple<const int*, const int*>(clusters.data(), clusters.data()), codes.data());
+    EXPECT_EQ(ref_codes, codes);
+    EXPECT_EQ(ref[0], std::get<0>(alt));
+    EXPECT_EQ(ref[1], std::get<1>(alt));
+
+    // Respects the options.
+    for (auto strategy : { factorize::CombineToFactorStrategy::MIXED_RADIX, factorize::CombineToFactorStrategy::SORT }) {
+        for (int threads = 1; threads <= 3; ++threads) {
+            factorize::CombineToFactorOptions opt;
+            opt.strategy = strategy;
+            opt.num_threads = threads;
+            std::vector<int> opt_codes(n, -1);
+            auto opt_levels = factorize::combine_to_factor(n, std::make_tuple(static_cast<const std::string*>(samples.data()), static_cast<const int*>(clusters.data()), static_cast<const double*>(doses.data())), opt_codes.data(), opt);
+            EXPECT_EQ(opt_codes, expected);
+            EXPECT_EQ(std::get<0>(opt_levels), expected_samples);
+            EXPECT_EQ(std::get<1>(opt_levels), expected_clusters);
+            EXPECT_EQ(std::get<2>(opt_levels), expected_doses);
+        }
+    }
+
+    // No variables.
+    std::vector<int> empty_codes(10, -1);
+    factorize::combine_to_factor(empty_codes.size(), std::tuple<>(), empty_codes.data());
+    EXPECT_EQ(empty_codes, std::vector<int>(10));
+}
+
+template<typename Factor_, std::size_t N_>
+void compare_combine_factors_array(std::size_t n, const std::array<const Factor_*, N_>& factors, const factorize::CombineToFactorOptions& options = factorize::CombineToFactorOptions()) {
+    std::vector<int> ref_codes(n);
+    auto ref = factorize::combine_to_factor(n, std::vector<const Factor_*>(factors.begin(), factors.end()), ref_codes.data());
+
+    std::vector<int> codes(n, -1);
+    auto levels = factorize::combine_to_factor(n, factors, codes.data(), options);
+    EXPECT_EQ(codes, ref_codes);
+    for (std::size_t f = 0; f < N_; ++f) {
+        EXPECT_EQ(levels[f], ref[f]);
+    }
+}
+
+TEST(CombineFactors, Array) {
+    std::mt19937_64 rng(7000);
+    const std::size_t n = 3000;
+    factorize::CombineToFactorOptions sopt;
+    sopt.strategy = factorize::CombineToFactorStrategy::SORT;
+
+    // Two 32-bit variables with negative values, packed into one word.
+    {
+        std::vector<int> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = static_cast<int>(rng() % 20) * 100000 - 1000000;
+            stuff2[i] = static_cast<int>(rng() % 30) * -100000;
+        }
+        std::array<const int*, 2> ptrs{ stuff1.data(), stuff2.data() };
+        compare_combine_factors_array(n, ptrs);
+        compare_combine_factors_array(n, ptrs, sopt);
+
+        // Three 32-bit variables, requiring two words.
+        std::array<const int*, 3> ptrs3{ stuff2.data(), stuff1.data(), stuff2.data() };
+        compare_combine_factors_array(n, ptrs3);
+    }
+
+    // Three 16-bit variables in a single word.
+    {
+        std::vector<std::int16_t> stuff1(n), stuff2(n), stuff3(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = static_cast<std::int16_t>(rng() % 20) * 1000 - 10000;
+            stuff2[i] = static_cast<std::int16_t>(rng() % 10) * 1000;
+            stuff3[i] = static_cast<std::int16_t>(rng() % 2) * 30000;
+        }
+        compare_combine_factors_array(n, std::array<const std::int16_t*, 3>{ stuff1.data(), stuff2.data(), stuff3.data() });
+    }
+
+    // Many 8-bit variables across multiple words.
+    {
+        std::vector<std::vector<unsigned char> > contents(10, std::vector<unsigned char>(n));
+        std::array<const unsigned char*, 10> ptrs;
+        for (std::size_t f = 0; f < contents.size(); ++f) {
+            for (auto& x : contents[f]) {
+                x = rng() % 2 * 200;
+            }
+            ptrs[f] = contents[f].data();
+        }
+        compare_combine_factors_array(n, ptrs);
+    }
+
+    // Dense integers.
+    {
+        std::vector<int> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = rng() % 10;
+            stuff2[i] = rng() % 20;
+        }
+        compare_combine_factors_array(n, std::array<const int*, 2>{ stuff1.data(), stuff2.data() });
+    }
+
+    // Falls back for other types.
+    {
+        std::vector<std::string> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = std::to_string(rng() % 10);
+            stuff2[i] = std::to_string(rng() % 20);
+        }
+        compare_combine_factors_array(n, std::array<const std::string*, 2>{ stuff1.data(), stuff2.data() });
+    }
+
+    // Empty.
+    {
+        std::vector<int> empty;
+        compare_combine_factors_array(0, std::array<const int*, 2>{ empty.data(), empty.data() });
+    }
+}
+
+template<typename Factor_>
+void compare_combine_factors_marginals(std::size_t n, const std::vector<const Factor_*>& factors, const factorize::CombineToFactorOptions& options = factorize::CombineToFactorOptions()) {
+    std::vector<int> ref_codes(n);
+    auto ref = factorize::combine_to_factor(n, factors, ref_codes.data());
+
+    std::vector<int> codes(n, -1);
+    factorize::CombineToFactorMarginals<Factor_, int> marginals;
+    auto levels = factorize::combine_to_factor(n, factors, codes.data(), options, marginals);
+    EXPECT_EQ(codes, ref_codes);
+    EXPECT_EQ(levels, ref);
+
+    const std::size_t nfactors = factors.size();
+    ASSERT_EQ(marginals.levels.size(), nfactors);
+    ASSERT_EQ(marginals.codes.size(), nfactors);
+    ASSERT_EQ(marginals.mapping.size(), nfactors);
+    for (std::size_t f = 0; f < nfactors; ++f) {
+        std::vector<Factor_> expected_levels(factors[f], factors[f] + n);
+        std::sort(expected_levels.begin(), expected_levels.end());
+        expected_levels.erase(std::unique(expected_levels.begin(), expected_levels.end()), expected_levels.end());
+        EXPECT_EQ(marginals.levels[f], expected_levels);
+
+        ASSERT_EQ(marginals.codes[f].size(), n);
+        for (std::size_t i = 0; i < n; ++i) {
+            EXPECT_EQ(marginals.levels[f][marginals.codes[f][i]], factors[f][i]);
+        }
+
+        ASSERT_EQ(marginals.mapping[f].size(), levels[f].size());
+        for (std::size_t c = 0; c < levels[f].size(); ++c) {
+            EXPECT_EQ(marginals.levels[f][marginals.mapping[f][c]], levels[f][c]);
+        }
+    }
+}
+
+TEST(CombineFactors, Marginals) {
+    std::mt19937_64 rng(8000);
+    const std::size_t n = 2000;
+    factorize::CombineToFactorOptions sopt;
+    sopt.strategy = factorize::CombineToFactorStrategy::SORT;
+    factorize::CombineToFactorOptions hopt;
+    hopt.strategy = factorize::CombineToFactorStrategy::HASH;
+    factorize::CombineToFactorOptions topt;
+    topt.num_threads = 3;
+
+    // Sparse integers, for the mixed-radix keys.
+    {
+        std::vector<int> stuff1(n), stuff2(n), stuff3(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = static_cast<int>(rng() % 20) * 997;
+            stuff2[i] = static_cast<int>(rng() % 15) * -1009;
+            stuff3[i] = static_cast<int>(rng() % 7) * 10007;
+        }
+        std::vector<const int*> ptrs{ stuff1.data(), stuff2.data(), stuff3.data() };
+        compare_combine_factors_marginals(n, ptrs);
+        compare_combine_factors_marginals(n, ptrs, sopt);
+        compare_combine_factors_marginals(n, ptrs, hopt);
+        compare_combine_factors_marginals(n, ptrs, topt);
+
+        compare_combine_factors_marginals(n, std::vector<const int*>{ stuff2.data() });
+        compare_combine_factors_marginals(n, std::vector<const int*>{});
+        compare_combine_factors_marginals(0, ptrs);
+    }
+
+    // Dense integers.
+    {
+        std::vector<int> stuff1(n), stuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = rng() % 10;
+            stuff2[i] = rng() % 20;
+        }
+        compare_combine_factors_marginals(n, std::vector<const int*>{ stuff1.data(), stuff2.data() });
+    }
+
+    // Nested variables, where the lane is determined by the sample.
+    {
+        std::vector<int> lane(n), sample(n), treatment(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            sample[i] = static_cast<int>(rng() % 30) * 101;
+            lane[i] = (sample[i] / 101) % 4;
+            treatment[i] = static_cast<int>(rng() % 5) * 1009;
+        }
+        std::vector<const int*> ptrs{ lane.data(), sample.data(), treatment.data() };
+        for (auto strategy : { factorize::CombineToFactorStrategy::MIXED_RADIX, factorize::CombineToFactorStrategy::SORT }) {
+            factorize::CombineToFactorOptions nopt;
+            nopt.strategy = strategy;
+            nopt.detect_nested = true;
+            compare_combine_factors_marginals(n, ptrs, nopt);
+            nopt.num_threads = 3;
+            compare_combine_factors_marginals(n, ptrs, nopt);
+        }
+    }
+
+    // Strings and non-hashable types.
+    {
+        std::vector<std::string> stuff1(n), stuff2(n);
+        std::vector<NonHashable> stuff3(n), stuff4(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            stuff1[i] = std::to_string(rng() % 10);
+            stuff2[i] = std::to_string(rng() % 20);
+            stuff3[i] = rng() % 10;
+            stuff4[i] = rng() % 20;
+        }
+        compare_combine_factors_marginals(n, std::vector<const std::string*>{ stuff1.data(), stuff2.data() });
+        compare_combine_factors_marginals(n, std::vector<const NonHashable*>{ stuff3.data(), stuff4.data() });
+    }
+}
+
+TEST(CombineFactors, Extend) {
+    std::mt19937_64 rng(9000);
+    const std::size_t n = 2000;
+    std::vector<int> sample(n), lane(n), treatment(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        sample[i] = static_cast<int>(rng() % 8) * 1001;
+        lane[i] = rng() % 4;
+        treatment[i] = static_cast<int>(rng() % 5) * -77;
+    }
+
+    std::vector<int> codes(n);
+    auto levels = factorize::extend_combined_factor(n, codes.data(), std::vector<std::vector<int> >{}, sample.data(), codes.data());
+    std::vector<int> ref_codes(n);
+    auto ref = factorize::combine_to_factor(n, std::vector<const int*>{ sample.data() }, ref_codes.data());
+    EXPECT_EQ(levels, ref);
+    EXPECT_EQ(codes, ref_codes);
+
+    // Operating in-place.
+    levels = factorize::extend_combined_factor(n, codes.data(), levels, lane.data(), codes.data());
+    ref = factorize::combine_to_factor(n, std::vector<const int*>{ sample.data(), lane.data() }, ref_codes.data());
+    EXPECT_EQ(levels, ref);
+    EXPECT_EQ(codes, ref_codes);
+
+    factorize::CombineToFactorOptions opt;
+    opt.strategy = factorize::CombineToFactorStrategy::SORT;
+    opt.num_threads = 3;
+    std::vector<int> new_codes(n);
+    auto new_levels = factorize::extend_combined_factor(n, codes.data(), levels, treatment.data(), new_codes.data(), opt);
+    ref = factorize::combine_to_factor(n, std::vector<const int*>{ sample.data(), lane.data(), treatment.data() }, ref_codes.data());
+    EXPECT_EQ(new_levels, ref);
+    EXPECT_EQ(new_codes, ref_codes);
+
+    // Empty.
+    std::vector<int> empty;
+    auto empty_levels = factorize::extend_combined_factor(0, empty.data(), std::vector<std::vector<int> >(2), empty.data(), empty.data());
+    EXPECT_EQ(empty_levels, std::vector<std::vector<int> >(3));
+}
+
+TEST(CombineFactors, Nested) {
+    std::mt19937_64 rng(10000);
+    const std::size_t n = 3000;
+
+    // Lanes nested within runs, samples nested within donors, and an independent treatment.
+    std::vector<int> run(n), lane(n), donor(n), sample(n), treatment(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        lane[i] = static_cast<int>(rng() % 12) * 101;
+        run[i] = lane[i] % 3 * -7;
+        sample[i] = rng() % 20;
+        donor[i] = (sample[i] * 7) % 5;
+        treatment[i] = rng() % 3;
+    }
+
+    factorize::CombineToFactorOptions opt;
+    opt.detect_nested = true;
+    const auto check = [&](const std::vector<const int*>& ptrs, const std::vector<std::pair<std::size_t, std::size_t> >& expected_nested) -> void {
+        std::vector<int> ref_codes(n);
+        auto ref = factorize::combine_to_factor(n, ptrs, ref_codes.data());
+
+        for (int threads = 1; threads <= 3; ++threads) {
+            opt.num_threads = threads;
+            std::vector<int> codes(n);
+            std::vector<std::pair<std::size_t, std::size_t> > nested;
+            auto levels = factorize::combine_to_factor(n, ptrs, codes.data(), opt, nested);
+            EXPECT_EQ(levels, ref);
+            EXPECT_EQ(codes, ref_codes);
+            EXPECT_EQ(nested, expected_nested);
+
+            factorize::FactorSummary summary, ref_summary;
+            factorize::combine_to_factor(n, ptrs, codes.data(), opt, summary);
+            factorize::combine_to_factor(n, ptrs, ref_codes.data(), factorize::CombineToFactorOptions(), ref_summary);
+            EXPECT_EQ(codes, ref_codes);
+            EXPECT_EQ(summary.counts, ref_summary.counts);
+            EXPECT_EQ(summary.first, ref_summary.first);
+            EXPECT_EQ(summary.last, ref_summary.last);
+        }
+    };
+
+    // Nested variable comes before its parent, which requires reordering.
+    check({ run.data(), lane.data() }, { { 0, 1 } });
+    check({ lane.data(), run.data() }, { { 1, 0 } });
+    check({ donor.data(), run.data(), sample.data(), treatment.data(), lane.data() }, { { 0, 2 }, { 1, 4 } });
+    check({ treatment.data(), sample.data() }, {});
+
+    // Identical variables are nested within each other, but only one is dropped.
+    check({ sample.data(), sample.data() }, { { 1, 0 } });
+
+    // Also works for the array overload.
+    compare_combine_factors_array(n, std::array<const int*, 3>{ donor.data(), sample.data(), treatment.data() }, opt);
+}
+
+class CombineFactorsParallelTest : public ::testing::TestWithParam<std::tuple<int, int> > {};
+
+TEST_P(CombineFactorsParallelTest, Consistency) {
+    auto param = GetParam();
+    const int range = std::get<0>(param);
+    const int nthreads = std::get<1>(param);
+
+    std::mt19937_64 rng(range * 10 + nthreads);
+    const std::size_t n = 5000;
+    std::vector<int> stuff1(n), stuff2(n), stuff3(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        stuff1[i] = static_cast<int>(rng() % range) * 7;
+        stuff2[i] = static_cast<int>(rng() % 3) * 7;
+        stuff3[i] = static_cast<int>(rng() % range) - range / 2;
+    }
+    std::vector<const int*> ptrs{ stuff1.data(), stuff2.data(), stuff3.data() };
+
+    for (auto strategy : { factorize::CombineToFactorStrategy::MIXED_RADIX, factorize::CombineToFactorStrategy::HASH }) {
+        factorize::CombineToFactorOptions opt;
+        opt.strategy = strategy;
+        std::vector<int> ref_codes(n);
+        factorize::FactorSummary ref_summary;
+        auto ref_levels = factorize::combine_to_factor(n, ptrs, ref_codes.data(), opt, ref_summary);
+
+        opt.num_threads = nthreads;
+        std::vector<int> codes(n, -1);
+        factorize::FactorSummary summary;
+        auto levels = factorize::combine_to_factor(n, ptrs, codes.data(), opt, summary);
+        EXPECT_EQ(levels, ref_levels);
+        EXPECT_EQ(codes, ref_codes);
+        EXPECT_EQ(summary.counts, ref_summary.counts);
+        EXPECT_EQ(summary.first, ref_summary.first);
+        EXPECT_EQ(summary.last, ref_summary.last);
+
+        std::fill(codes.begin(), codes.end(), -1);
+        levels = factorize::combine_to_factor(n, ptrs, codes.data(), opt);
+        EXPECT_EQ(levels, ref_levels);
+        EXPECT_EQ(codes, ref_codes);
+
+        auto alevels = factorize::combine_to_factor(n, std::array<const int*, 3>{ stuff1.data(), stuff2.data(), stuff3.data() }, codes.data(), opt);
+        EXPECT_EQ(codes, ref_codes);
+        for (int f = 0; f < 3; ++f) {
+            EXPECT_EQ(alevels[f], ref_levels[f]);
+        }
+    }
+
+    // Ensuring that the representative value is the same as the serial case, e.g., for signed zeros.
+    {
+        std::vector<double> dstuff1(n), dstuff2(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            dstuff1[i] = (rng() % 2 ? -0.0 : 0.0);
+            dstuff2[i] = static_cast<double>(rng() % range) / 3;
+        }
+        std::vector<const double*> dptrs{ dstuff1.data(), dstuff2.data() };
+
+        factorize::CombineToFactorOptions opt;
+        opt.strategy = factorize::CombineToFactorStrategy::HASH;
+        std::vector<int> ref_codes(n);
+        auto ref_levels = factorize::combine_to_factor(n, dptrs, ref_codes.data(), opt);
+
+        opt.num_threads = nthreads;
+        std::vector<int> codes(n, -1);
+        auto levels = factorize::combine_to_factor(n, dptrs, codes.data(), opt);
+        EXPECT_EQ(codes, ref_codes);
+        for (std::size_t u = 0; u < ref_levels[0].size(); ++u) {
+            EXPECT_EQ(std::signbit(levels[0][u]), std::signbit(ref_levels[0][u]));
+        }
+        EXPECT_EQ(levels[1], ref_levels[1]);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    CombineFactors,
+    CombineFactorsParallelTest,
+    ::testing::Combine(
+        ::testing::Values(5, 100, 5000), // number of possible levels
+        ::testing::Values(1, 2, 3, 7) // number of threads
+    )
+);
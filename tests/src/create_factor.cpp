@@ -2,6 +2,13 @@
 
 #include <random>
 #include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <tuple>
+#include <limits>
+#include <cmath>
 
 #include "factorize/create_factor.hpp"
 
@@ -55,3 +62,512 @@ TEST(CleanFactors, Simple) {
         EXPECT_EQ(cleand.first, levels);
     }
 }
+
+TEST(CleanFactors, Dense) {
+    // Already a compact factor.
+    {
+        std::vector<int> stuff{ 2, 0, 1, 3, 1, 0, 2 };
+        auto cleand = test_create_factor(stuff.size(), stuff.data());
+        EXPECT_EQ(cleand.second, stuff);
+        std::vector<int> expected { 0, 1, 2, 3 };
+        EXPECT_EQ(cleand.first, expected);
+    }
+
+    // Compact but shifted, including negative values.
+    {
+        std::vector<int> stuff{ -1, 1, 0, -2, 0, 1 };
+        auto cleand = test_create_factor(stuff.size(), stuff.data());
+        std::vector<int> cleaned { 1, 3, 2, 0, 2, 3 };
+        EXPECT_EQ(cleand.second, cleaned);
+        std::vector<int> expected { -2, -1, 0, 1 };
+        EXPECT_EQ(cleand.first, expected);
+    }
+
+    // Gaps in the range.
+    {
+        std::vector<int> stuff{ -5, 2, 2, -5, 0, 0, 1 };
+        auto cleand = test_create_factor(stuff.size(), stuff.data());
+        std::vector<int> cleaned { 0, 3, 3, 0, 1, 1, 2 };
+        EXPECT_EQ(cleand.second, cleaned);
+        std::vector<int> expected { -5, 0, 1, 2 };
+        EXPECT_EQ(cleand.first, expected);
+    }
+
+    // Extreme values for small types.
+    {
+        std::vector<signed char> stuff{ -128, 127, 0, 127 };
+        auto cleand = test_create_factor(stuff.size(), stuff.data());
+        std::vector<int> cleaned { 0, 2, 1, 2 };
+        EXPECT_EQ(cleand.second, cleaned);
+        std::vector<signed char> expected { -128, 0, 127 };
+        EXPECT_EQ(cleand.first, expected);
+
+        std::vector<unsigned char> stuff2(300);
+        for (std::size_t i = 0; i < stuff2.size(); ++i) {
+            stuff2[i] = 255 - (i % 256);
+        }
+        auto cleand2 = test_create_factor(stuff2.size(), stuff2.data());
+        for (std::size_t i = 0; i < stuff2.size(); ++i) {
+            EXPECT_EQ(cleand2.second[i], stuff2[i]);
+        }
+        EXPECT_EQ(cleand2.first.size(), 256);
+    }
+}
+
+TEST(CleanFactors, Simulated) {
+    std::mt19937_64 rng(42);
+    for (int range : { 5, 50, 500, 5000 }) {
+        std::vector<long long> stuff(1000);
+        for (auto& s : stuff) {
+            s = static_cast<long long>(rng() % range) - range / 2;
+        }
+        auto cleand = test_create_factor(stuff.size(), stuff.data());
+
+        std::vector<long long> expected(stuff);
+        std::sort(expected.begin(), expected.end());
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        EXPECT_EQ(cleand.first, expected);
+
+        for (std::size_t i = 0; i < stuff.size(); ++i) {
+            EXPECT_EQ(cleand.first[cleand.second[i]], stuff[i]);
+        }
+    }
+}
+
+TEST(CleanFactors, Hashed) {
+    // Strings, which can't use the dense path.
+    {
+        std::vector<std::string> stuff{ "C", "A", "B", "A", "C", "D" };
+        auto cleand = test_create_factor(stuff.size(), stuff.data());
+        std::vector<int> cleaned{ 2, 0, 1, 0, 2, 3 };
+        EXPECT_EQ(cleand.second, cleaned);
+        std::vector<std::string> expected { "A", "B", "C", "D" };
+        EXPECT_EQ(cleand.first, expected);
+    }
+
+    // High-cardinality input that forces the table to grow multiple times.
+    {
+        std::mt19937_64 rng(69);
+        std::vector<std::uint64_t> stuff(20000);
+        for (auto& s : stuff) {
+            s = rng() % 5000 * 1000003;
+        }
+        auto cleand = test_create_factor(stuff.size(), stuff.data());
+
+        std::vector<std::uint64_t> expected(stuff);
+        std::sort(expected.begin(), expected.end());
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        EXPECT_EQ(cleand.first, expected);
+
+        for (std::size_t i = 0; i < stuff.size(); ++i) {
+            EXPECT_EQ(cleand.first[cleand.second[i]], stuff[i]);
+        }
+    }
+}
+
+class CleanFactorsParallelTest : public ::testing::TestWithParam<std::tuple<int, int> > {};
+
+TEST_P(CleanFactorsParallelTest, Consistency) {
+    auto param = GetParam();
+    const int range = std::get<0>(param);
+    const int nthreads = std::get<1>(param);
+
+    std::mt19937_64 rng(range * 10 + nthreads);
+    std::vector<long long> stuff(5000);
+    for (auto& s : stuff) {
+        s = static_cast<long long>(rng() % range) * 7 - range;
+    }
+    auto ref = test_create_factor(stuff.size(), stuff.data());
+
+    factorize::CreateFactorOptions opt;
+    opt.num_threads = nthreads;
+    std::vector<int> codes(stuff.size(), -1);
+    auto levels = factorize::create_factor(stuff.size(), stuff.data(), codes.data(), opt);
+    EXPECT_EQ(ref.first, levels);
+    EXPECT_EQ(ref.second, codes);
+
+    // Same for the dense path.
+    std::vector<int> dense_stuff(stuff.size());
+    for (auto& s : dense_stuff) {
+        s = rng() % range;
+    }
+    auto dense_ref = test_create_factor(dense_stuff.size(), dense_stuff.data());
+    auto dense_levels = factorize::create_factor(dense_stuff.size(), dense_stuff.data(), codes.data(), opt);
+    EXPECT_EQ(dense_ref.first, dense_levels);
+    EXPECT_EQ(dense_ref.second, codes);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    CleanFactors,
+    CleanFactorsParallelTest,
+    ::testing::Combine(
+        ::testing::Values(5, 100, 5000, 100000), // number of possible levels
+        ::testing::Values(1, 2, 3, 7) // number of threads
+    )
+);
+
+TEST(CleanFactors, ParallelSignedZero) {
+    // -0.0 and +0.0 compare equal, so the level should be represented by the first occurrence regardless of the number of threads.
+    std::mt19937_64 rng(4242);
+    for (int trial = 0; trial < 500; ++trial) {
+        const std::size_t n = rng() % 2000 + 100;
+        const int nthreads = rng() % 14 + 2;
+
+        // Flipping the sign of the zeros in each thread's block, with negative values so that the zeros are not all at the top of the heap.
+        std::vector<double> stuff(n);
+        const std::size_t block_size = (n + nthreads - 1) / nthreads;
+        for (std::size_t i = 0; i < n; ++i) {
+            const bool negative = (i / block_size) % 2 == static_cast<std::size_t>(trial % 2);
+            stuff[i] = (rng() % 3 == 0 ? (negative ? -0.0 : 0.0) : static_cast<double>(rng() % 3 + 1) * (rng() % 2 ? 1 : -1));
+        }
+        auto ref = test_create_factor(stuff.size(), stuff.data());
+        ASSERT_EQ(ref.first[3], 0);
+
+        factorize::CreateFactorOptions opt;
+        opt.num_threads = nthreads;
+        std::vector<int> codes(n);
+        auto levels = factorize::create_factor(n, stuff.data(), codes.data(), opt);
+        EXPECT_EQ(levels, ref.first);
+        EXPECT_EQ(codes, ref.second);
+        EXPECT_EQ(std::signbit(levels[3]), std::signbit(ref.first[3]));
+    }
+}
+
+template<typename Factor_>
+std::pair<std::vector<Factor_>, std::vector<int> > test_create_factor_sorted(std::size_t n, const Factor_* factor) {
+    std::vector<int> cleand(n, -1);
+    factorize::CreateFactorOptions opt;
+    opt.strategy = factorize::CreateFactorStrategy::SORT;
+    auto levels = factorize::create_factor(n, factor, cleand.data(), opt);
+    return std::make_pair(std::move(levels), std::move(cleand));
+}
+
+TEST(CleanFactors, SortStrategy) {
+    {
+        std::vector<double> stuff{ 1.5, -2.5, 0.0, 1.5, -0.0, -1e100, std::numeric_limits<double>::infinity(), -2.5 };
+        auto cleand = test_create_factor_sorted(stuff.size(), stuff.data());
+        std::vector<int> cleaned{ 3, 1, 2, 3, 2, 0, 4, 1 };
+        EXPECT_EQ(cleand.second, cleaned);
+        std::vector<double> expected { -1e100, -2.5, 0, 1.5, std::numeric_limits<double>::infinity() };
+        EXPECT_EQ(cleand.first, expected);
+    }
+
+    {
+        std::vector<std::int64_t> stuff{ 
+            std::numeric_limits<std::int64_t>::max(),
+            -1,
+            std::numeric_limits<std::int64_t>::min(),
+            1000000000000,
+            -1 
+        };
+        auto cleand = test_create_factor_sorted(stuff.size(), stuff.data());
+        std::vector<int> cleaned{ 3, 1, 0, 2, 1 };
+        EXPECT_EQ(cleand.second, cleaned);
+    }
+
+    // Empty inputs are handled correctly.
+    {
+        std::vector<float> stuff;
+        auto cleand = test_create_factor_sorted(stuff.size(), stuff.data());
+        EXPECT_TRUE(cleand.first.empty());
+    }
+
+    // Consistent with the hash-based strategy.
+    std::mt19937_64 rng(999);
+    {
+        std::vector<float> stuff(2000);
+        for (auto& s : stuff) {
+            s = static_cast<float>(static_cast<int>(rng() % 200) - 100) / 7;
+        }
+        auto ref = test_create_factor(stuff.size(), stuff.data());
+        auto cleand = test_create_factor_sorted(stuff.size(), stuff.data());
+        EXPECT_EQ(ref.first, cleand.first);
+        EXPECT_EQ(ref.second, cleand.second);
+    }
+
+    {
+        std::vector<int> stuff(2000);
+        for (auto& s : stuff) {
+            s = static_cast<int>(rng() % 1000000) - 500000;
+        }
+        auto ref = test_create_factor(stuff.size(), stuff.data());
+        auto cleand = test_create_factor_sorted(stuff.size(), stuff.data());
+        EXPECT_EQ(ref.first, cleand.first);
+        EXPECT_EQ(ref.second, cleand.second);
+    }
+
+    // Falls back to the hash for non-arithmetic types.
+    {
+        std::vector<std::string> stuff{ "B", "A", "B" };
+        auto cleand = test_create_factor_sorted(stuff.size(), stuff.data());
+        std::vector<int> cleaned{ 1, 0, 1 };
+        EXPECT_EQ(cleand.second, cleaned);
+    }
+}
+
+template<typename Factor_>
+std::pair<std::vector<Factor_>, std::vector<int> > test_create_factor_runs(std::size_t n, const Factor_* factor, int nthreads = 1) {
+    std::vector<int> cleand(n, -1);
+    factorize::CreateFactorOptions opt;
+    opt.detect_runs = true;
+    opt.num_threads = nthreads;
+    auto levels = factorize::create_factor(n, factor, cleand.data(), opt);
+    return std::make_pair(std::move(levels), std::move(cleand));
+}
+
+TEST(CleanFactors, Runs) {
+    // Increasing.
+    {
+        std::vector<std::string> stuff{ "A", "A", "B", "D", "D", "D", "E" };
+        auto cleand = test_create_factor_runs(stuff.size(), stuff.data());
+        std::vector<int> cleaned{ 0, 0, 1, 2, 2, 2, 3 };
+        EXPECT_EQ(cleand.second, cleaned);
+        std::vector<std::string> expected { "A", "B", "D", "E" };
+        EXPECT_EQ(cleand.first, expected);
+    }
+
+    // Decreasing.
+    {
+        std::vector<double> stuff{ 5, 5, 3, 2.5, 2.5, 1 };
+        auto cleand = test_create_factor_runs(stuff.size(), stuff.data());
+        std::vector<int> cleaned{ 3, 3, 2, 1, 1, 0 };
+        EXPECT_EQ(cleand.second, cleaned);
+        std::vector<double> expected { 1, 2.5, 3, 5 };
+        EXPECT_EQ(cleand.first, expected);
+    }
+
+    // Constant.
+    {
+        std::vector<std::string> stuff(10, "X");
+        auto cleand = test_create_factor_runs(stuff.size(), stuff.data());
+        EXPECT_EQ(cleand.second, std::vector<int>(10));
+        EXPECT_EQ(cleand.first, std::vector<std::string>{ "X" });
+    }
+
+    // Empty.
+    {
+        std::vector<std::string> stuff;
+        auto cleand = test_create_factor_runs(stuff.size(), stuff.data());
+        EXPECT_TRUE(cleand.first.empty());
+    }
+
+    // NaNs are not equal to their neighbors, so they shouldn't be merged into their runs.
+    {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        std::vector<double> stuff{ 1, 1, nan, 2, 2 };
+        auto cleand = test_create_factor_runs(stuff.size(), stuff.data());
+        EXPECT_EQ(cleand.second, std::vector<int>({ 0, 0, 1, 2, 2 }));
+        ASSERT_EQ(cleand.first.size(), 3);
+        EXPECT_EQ(cleand.first[0], 1);
+        EXPECT_TRUE(std::isnan(cleand.first[1]));
+        EXPECT_EQ(cleand.first[2], 2);
+    }
+
+    // Not monotonic, but with runs.
+    std::mt19937_64 rng(123);
+    std::vector<std::string> stuff;
+    for (int r = 0; r < 200; ++r) {
+        std::string current(1, 'A' + rng() % 26);
+        stuff.insert(stuff.end(), rng() % 20 + 1, current);
+    }
+    auto ref = test_create_factor(stuff.size(), stuff.data());
+    for (int nthreads : { 1, 3 }) {
+        auto cleand = test_create_factor_runs(stuff.size(), stuff.data(), nthreads);
+        EXPECT_EQ(ref.first, cleand.first);
+        EXPECT_EQ(ref.second, cleand.second);
+    }
+}
+
+TEST(CleanFactors, Unsorted) {
+    // Dense path.
+    {
+        std::vector<int> stuff{ 3, 1, 3, 2, 1, 5 };
+        std::vector<int> codes(stuff.size(), -1);
+        auto levels = factorize::create_factor_unsorted(stuff.size(), stuff.data(), codes.data());
+        EXPECT_EQ(levels, std::vector<int>({ 3, 1, 2, 5 }));
+        EXPECT_EQ(codes, std::vector<int>({ 0, 1, 0, 2, 1, 3 }));
+
+        auto remap = factorize::sort_levels<int>(levels);
+        EXPECT_EQ(levels, std::vector<int>({ 1, 2, 3, 5 }));
+        EXPECT_EQ(remap, std::vector<int>({ 2, 0, 1, 3 }));
+    }
+
+    // Hash path.
+    {
+        std::vector<std::string> stuff{ "C", "A", "C", "B", "A" };
+        std::vector<int> codes(stuff.size(), -1);
+        auto levels = factorize::create_factor_unsorted(stuff.size(), stuff.data(), codes.data());
+        EXPECT_EQ(levels, std::vector<std::string>({ "C", "A", "B" }));
+        EXPECT_EQ(codes, std::vector<int>({ 0, 1, 0, 2, 1 }));
+    }
+
+    // Consistent with the sorted version, regardless of the number of threads.
+    std::mt19937_64 rng(1234);
+    for (int scale : { 1, 1000 }) {
+        std::vector<int> stuff(2000);
+        for (auto& s : stuff) {
+            s = static_cast<int>(rng() % 300) * scale;
+        }
+        auto ref = test_create_factor(stuff.size(), stuff.data());
+
+        std::vector<int> ref_codes(stuff.size());
+        auto ref_levels = factorize::create_factor_unsorted(stuff.size(), stuff.data(), ref_codes.data());
+        for (std::size_t i = 0; i < stuff.size(); ++i) {
+            EXPECT_EQ(ref_levels[ref_codes[i]], stuff[i]);
+        }
+
+        for (int nthreads : { 2, 3 }) {
+            factorize::CreateFactorOptions opt;
+            opt.num_threads = nthreads;
+            opt.detect_runs = true;
+            std::vector<int> codes(stuff.size());
+            auto levels = factorize::create_factor_unsorted(stuff.size(), stuff.data(), codes.data(), opt);
+            EXPECT_EQ(levels, ref_levels);
+            EXPECT_EQ(codes, ref_codes);
+        }
+
+        auto remap = factorize::sort_levels<int>(ref_levels);
+        EXPECT_EQ(ref_levels, ref.first);
+        for (auto& c : ref_codes) {
+            c = remap[c];
+        }
+        EXPECT_EQ(ref_codes, ref.second);
+    }
+}
+
+template<typename Factor_>
+void check_summary(const std::vector<Factor_>& stuff, const factorize::CreateFactorOptions& opt) {
+    std::vector<int> ref_codes(stuff.size());
+    auto ref_levels = factorize::create_factor(stuff.size(), stuff.data(), ref_codes.data());
+
+    std::vector<int> codes(stuff.size(), -1);
+    factorize::FactorSummary summary;
+    auto levels = factorize::create_factor(stuff.size(), stuff.data(), codes.data(), opt, summary);
+    EXPECT_EQ(levels, ref_levels);
+    EXPECT_EQ(codes, ref_codes);
+
+    const auto nlevels = levels.size();
+    std::vector<std::size_t> counts(nlevels), first(nlevels, -1), last(nlevels);
+    for (std::size_t i = 0; i < codes.size(); ++i) {
+        const auto c = codes[i];
+        ++counts[c];
+        first[c] = std::min(first[c], i);
+        last[c] = i;
+    }
+    EXPECT_EQ(summary.counts, counts);
+    EXPECT_EQ(summary.first, first);
+    EXPECT_EQ(summary.last, last);
+}
+
+TEST(CleanFactors, Summary) {
+    std::mt19937_64 rng(999);
+    factorize::CreateFactorOptions opt;
+
+    // Dense path.
+    {
+        std::vector<int> stuff(1000);
+        for (auto& s : stuff) {
+            s = static_cast<int>(rng() % 50) - 20;
+        }
+        check_summary(stuff, opt);
+    }
+
+    // Hash path, with and without threads.
+    {
+        std::vector<int> stuff(5000);
+        for (auto& s : stuff) {
+            s = static_cast<int>(rng() % 200) * 100000;
+        }
+        check_summary(stuff, opt);
+        opt.num_threads = 3;
+        check_summary(stuff, opt);
+        opt.num_threads = 1;
+
+        std::vector<std::string> sstuff;
+        for (auto s : stuff) {
+            sstuff.push_back(std::to_string(s));
+        }
+        check_summary(sstuff, opt);
+    }
+
+    // Sort path.
+    {
+        std::vector<double> stuff(2000);
+        for (auto& s : stuff) {
+            s = static_cast<double>(rng() % 100) / 7;
+        }
+        opt.strategy = factorize::CreateFactorStrategy::SORT;
+        check_summary(stuff, opt);
+        opt.strategy = factorize::CreateFactorStrategy::HASH;
+    }
+
+    // Monotonic path, in both directions.
+    {
+        opt.detect_runs = true;
+        std::vector<std::string> stuff{ "A", "A", "B", "D", "D", "D", "E" };
+        check_summary(stuff, opt);
+        std::reverse(stuff.begin(), stuff.end());
+        check_summary(stuff, opt);
+        opt.detect_runs = false;
+    }
+
+    // Empty.
+    {
+        factorize::FactorSummary summary;
+        summary.counts.resize(5);
+        auto levels = factorize::create_factor(0, static_cast<const int*>(NULL), static_cast<int*>(NULL), opt, summary);
+        EXPECT_TRUE(levels.empty());
+        EXPECT_TRUE(summary.counts.empty());
+        EXPECT_TRUE(summary.first.empty());
+        EXPECT_TRUE(summary.last.empty());
+    }
+}
+
+TEST(CleanFactors, FullCodeRange) {
+    // Using every possible value of the code type, which checks that the hash table doesn't confuse the last code with an empty slot.
+    std::vector<std::string> strings;
+    for (int i = 0; i < 256; ++i) {
+        strings.push_back("level_" + std::to_string(i));
+    }
+    const auto copy = strings;
+    strings.insert(strings.end(), copy.begin(), copy.end());
+    std::vector<unsigned char> scodes(strings.size());
+    auto slevels = factorize::create_factor(strings.size(), strings.data(), scodes.data());
+    EXPECT_EQ(slevels.size(), 256);
+    for (std::size_t i = 0; i < strings.size(); ++i) {
+        EXPECT_EQ(slevels[scodes[i]], strings[i]);
+    }
+
+    // Sparse integers that don't use the lookup table.
+    std::vector<std::int64_t> sparse;
+    for (std::int64_t i = 0; i < 65536; ++i) {
+        sparse.push_back(i * 1000003);
+    }
+    sparse.push_back(sparse.back());
+    sparse.push_back(sparse.front());
+    std::vector<std::uint16_t> icodes(sparse.size());
+    auto ilevels = factorize::create_factor(sparse.size(), sparse.data(), icodes.data());
+    EXPECT_EQ(ilevels.size(), 65536);
+    for (std::size_t i = 0; i < sparse.size(); ++i) {
+        EXPECT_EQ(ilevels[icodes[i]], sparse[i]);
+    }
+
+    // Dense integers for the lookup table in the unsorted case.
+    std::vector<int> dense(512);
+    for (int i = 0; i < 512; ++i) {
+        dense[i] = 255 - i % 256;
+    }
+    std::vector<unsigned char> dcodes(dense.size());
+    auto dlevels = factorize::create_factor_unsorted(dense.size(), dense.data(), dcodes.data());
+    EXPECT_EQ(dlevels.size(), 256);
+    for (std::size_t i = 0; i < dense.size(); ++i) {
+        EXPECT_EQ(dlevels[dcodes[i]], dense[i]);
+    }
+
+    std::vector<unsigned char> ucodes(strings.size());
+    auto ulevels = factorize::create_factor_unsorted(strings.size(), strings.data(), ucodes.data());
+    EXPECT_EQ(ulevels.size(), 256);
+    for (std::size_t i = 0; i < strings.size(); ++i) {
+        EXPECT_EQ(ulevels[ucodes[i]], strings[i]);
+    }
+}
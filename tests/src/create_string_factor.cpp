@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+#include "factorize/create_string_factor.hpp"
+
+TEST(CreateStringFactor, Basic) {
+    std::vector<std::string> stuff{ "CCC", "A", "", "BB", "A", "CCC" };
+    std::vector<int> codes(stuff.size(), -1);
+    auto levels = factorize::create_string_factor(stuff.size(), stuff.data(), codes.data());
+
+    std::vector<int> expected_codes{ 3, 1, 0, 2, 1, 3 };
+    EXPECT_EQ(codes, expected_codes);
+    EXPECT_EQ(levels.size(), 4);
+    std::vector<std::string_view> expected_levels{ "", "A", "BB", "CCC" };
+    EXPECT_EQ(levels.views(), expected_levels);
+
+    // Works with string views and C strings.
+    std::vector<std::string_view> views(stuff.begin(), stuff.end());
+    std::vector<int> vcodes(views.size(), -1);
+    auto vlevels = factorize::create_string_factor(views.size(), views.data(), vcodes.data());
+    EXPECT_EQ(vcodes, expected_codes);
+    EXPECT_EQ(vlevels.views(), expected_levels);
+
+    std::vector<const char*> cstrs;
+    for (const auto& s : stuff) {
+        cstrs.push_back(s.c_str());
+    }
+    std::vector<int> ccodes(cstrs.size(), -1);
+    auto clevels = factorize::create_string_factor(cstrs.size(), cstrs.data(), ccodes.data());
+    EXPECT_EQ(ccodes, expected_codes);
+    EXPECT_EQ(clevels.views(), expected_levels);
+}
+
+TEST(CreateStringFactor, PointersAndLengths) {
+    std::string buffer = "AAABBAACAAAB";
+    std::vector<const char*> pointers;
+    std::vector<std::size_t> lengths;
+    for (std::size_t i = 0; i < buffer.size(); i += 3) {
+        pointers.push_back(buffer.data() + i);
+        lengths.push_back(2);
+    }
+
+    std::vector<int> codes(pointers.size(), -1);
+    auto levels = factorize::create_string_factor(pointers.size(), pointers.data(), lengths.data(), codes.data());
+    std::vector<int> expected_codes{ 0, 2, 1, 0 };
+    EXPECT_EQ(codes, expected_codes);
+    std::vector<std::string_view> expected_levels{ "AA", "AC", "BB" };
+    EXPECT_EQ(levels.views(), expected_levels);
+}
+
+TEST(CreateStringFactor, Options) {
+    std::mt19937_64 rng(1000);
+    std::vector<std::string> stuff;
+    for (int i = 0; i < 1000; ++i) {
+        stuff.push_back(std::to_string(rng() % 100));
+    }
+
+    std::vector<int> ref_codes(stuff.size());
+    auto ref_levels = factorize::create_factor(stuff.size(), stuff.data(), ref_codes.data());
+    std::vector<std::string_view> ref_views(ref_levels.begin(), ref_levels.end());
+
+    factorize::CreateFactorOptions opt;
+    opt.num_threads = 3;
+    std::vector<int> codes(stuff.size());
+    auto levels = factorize::create_string_factor(stuff.size(), stuff.data(), codes.data(), opt);
+    EXPECT_EQ(codes, ref_codes);
+    EXPECT_EQ(levels.views(), ref_views);
+
+    // Monotonic input.
+    std::sort(stuff.begin(), stuff.end());
+    opt.detect_runs = true;
+    factorize::create_factor(stuff.size(), stuff.data(), ref_codes.data());
+    levels = factorize::create_string_factor(stuff.size(), stuff.data(), codes.data(), opt);
+    EXPECT_EQ(codes, ref_codes);
+    EXPECT_EQ(levels.views(), ref_views);
+}
+
+TEST(CreateStringFactor, Empty) {
+    std::vector<std::string> stuff;
+    auto levels = factorize::create_string_factor(stuff.size(), stuff.data(), static_cast<int*>(NULL));
+    EXPECT_EQ(levels.size(), 0);
+}
+
+TEST(CreateStringFactor, FullCodeRange) {
+    std::vector<std::string> stuff;
+    for (int i = 0; i < 256; ++i) {
+        stuff.push_back(std::to_string(i));
+    }
+    const auto copy = stuff;
+    stuff.insert(stuff.end(), copy.begin(), copy.end());
+
+    std::vector<unsigned char> codes(stuff.size());
+    auto levels = factorize::create_string_factor(stuff.size(), stuff.data(), codes.data());
+    EXPECT_EQ(levels.size(), 256);
+    const auto views = levels.views();
+    for (std::size_t i = 0; i < stuff.size(); ++i) {
+        EXPECT_EQ(views[codes[i]], stuff[i]);
+    }
+}